@@ -0,0 +1,153 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "hashmap_ext.h"
+#include "bench_common.h"
+
+/**
+ * Measures random hashmap_at probes into a large hashmap whose buckets
+ * are allocated under the different bucket_alloc policies, reporting time,
+ * dTLB load misses and, for the NUMA policies, loads that missed the local
+ * node. Binding is to node 0.
+ * Usage: bench_buckets [log2 of key count] [probes]
+ */
+
+#define DEFAULT_BITS 22
+#define DEFAULT_PROBES 20000000UL
+#define POLICY_COUNT 5
+#define COUNTER_COUNT 2
+
+// Opens a read-miss counter of a cache (a PERF_COUNT_HW_CACHE_* id) for
+// this thread, -1 if perf is unavailable.
+int open_miss_counter (uint64_t cache)
+{
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.type = PERF_TYPE_HW_CACHE;
+  attr.size = sizeof(attr);
+  attr.config = cache
+                | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+// Builds a map of count int keys (key i maps to i) under a policy, with its
+// bucket array grown up front so it is allocated under the policy once. The
+// bucket vectors and slot arrays follow the policy as they are inserted.
+hashmap *build_map (size_t count, const bucket_policy *policy)
+{
+  hashmap *map = hashmap_alloc(bench_hash_int);
+  if (map == NULL || hashmap_set_bucket_policy(map, policy) == 0
+      || hashmap_reserve(map, count) == 0)
+    {
+      if (map != NULL)
+        {
+          hashmap_free(&map);
+        }
+      return NULL;
+    }
+  int i = 0;
+  for (i = 0; (size_t) i < count; i++)
+    {
+      pair *p = pair_alloc(&i, &i, bench_int_cpy, bench_int_cpy,
+                           bench_int_cmp, bench_int_cmp, bench_int_free,
+                           bench_int_free);
+      int check = p != NULL && hashmap_insert(map, p);
+      pair_free((void **) &p);
+      if (!check)
+        {
+          hashmap_free(&map);
+          return NULL;
+        }
+    }
+  return map;
+}
+
+int main (int argc, char *argv[])
+{
+  size_t bits = argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_BITS;
+  size_t probes = argc > 2 ? strtoul(argv[2], NULL, 10) : DEFAULT_PROBES;
+  size_t count = ((size_t) 1) << bits;
+  const char *names[POLICY_COUNT] = {"4K pages", "THP madvise", "MAP_HUGETLB",
+                                     "NUMA interleave", "NUMA bind"};
+  bucket_policy policies[POLICY_COUNT] = {
+      {BUCKET_ALLOC_DEFAULT, 0},
+      {BUCKET_ALLOC_HUGE_PAGES, 0},
+      {BUCKET_ALLOC_HUGETLB, 0},
+      {BUCKET_ALLOC_HUGE_PAGES | BUCKET_ALLOC_NUMA_INTERLEAVE, 0},
+      {BUCKET_ALLOC_HUGE_PAGES | BUCKET_ALLOC_NUMA_BIND, 0}};
+  int fds[COUNTER_COUNT] = {open_miss_counter(PERF_COUNT_HW_CACHE_DTLB),
+                            open_miss_counter(PERF_COUNT_HW_CACHE_NODE)};
+  if (fds[0] < 0)
+    {
+      printf("perf_event_open unavailable, reporting time only\n");
+    }
+  int p = 0;
+  int c = 0;
+  for (p = 0; p < POLICY_COUNT; p++)
+    {
+      hashmap *map = build_map(count, &policies[p]);
+      if (map == NULL)
+        {
+          printf("%-15s allocation failed\n", names[p]);
+          continue;
+        }
+      uint64_t x = 88172645463325252ULL;
+      long sum = 0;
+      uint64_t misses[COUNTER_COUNT] = {0, 0};
+      size_t i = 0;
+      for (c = 0; c < COUNTER_COUNT; c++)
+        {
+          if (fds[c] >= 0)
+            {
+              ioctl(fds[c], PERF_EVENT_IOC_RESET, 0);
+              ioctl(fds[c], PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+      double start = now_sec();
+      for (i = 0; i < probes; i++)
+        {
+          x ^= x << 13;
+          x ^= x >> 7;
+          x ^= x << 17;
+          int key = (int) (x & (count - 1));
+          sum += *(int *) hashmap_at(map, &key);
+        }
+      double elapsed = now_sec() - start;
+      for (c = 0; c < COUNTER_COUNT; c++)
+        {
+          if (fds[c] < 0)
+            {
+              continue;
+            }
+          ioctl(fds[c], PERF_EVENT_IOC_DISABLE, 0);
+          if (read(fds[c], &misses[c], sizeof(misses[c]))
+              != sizeof(misses[c]))
+            {
+              misses[c] = 0;
+            }
+        }
+      printf("%-15s %8.2f ns/lookup %12llu dTLB misses %12llu node misses "
+             "(%lu buckets, checksum %ld)\n", names[p],
+             elapsed * 1e9 / probes, (unsigned long long) misses[0],
+             (unsigned long long) misses[1], (unsigned long) map->capacity,
+             sum);
+      hashmap_free(&map);
+    }
+  for (c = 0; c < COUNTER_COUNT; c++)
+    {
+      if (fds[c] >= 0)
+        {
+          close(fds[c]);
+        }
+    }
+  return 0;
+}
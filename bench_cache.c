@@ -0,0 +1,65 @@
+#define _POSIX_C_SOURCE 199309L
+#include <stdio.h>
+#include "cache_hashmap.h"
+#include "bench_common.h"
+
+/**
+ * Compares the hit path of cache_hashmap_at with a plain hashmap_at over the
+ * same keys.
+ * Usage: bench_cache [entries] [lookups]
+ */
+
+#define DEFAULT_ENTRIES 1000000UL
+#define DEFAULT_LOOKUPS 10000000UL
+
+int main (int argc, char *argv[])
+{
+  size_t entries = argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_ENTRIES;
+  size_t lookups = argc > 2 ? strtoul(argv[2], NULL, 10) : DEFAULT_LOOKUPS;
+  hashmap *map = hashmap_alloc(bench_hash_int);
+  cache_hashmap *cache = cache_hashmap_alloc(bench_hash_int, entries, NULL,
+                                             NULL, NULL);
+  if (map == NULL || cache == NULL)
+    {
+      return 1;
+    }
+  int i = 0;
+  for (i = 0; (size_t) i < entries; i++)
+    {
+      pair *p = pair_alloc(&i, &i, bench_int_cpy, bench_int_cpy,
+                           bench_int_cmp, bench_int_cmp, bench_int_free,
+                           bench_int_free);
+      if (p == NULL || hashmap_insert(map, p) == 0
+          || cache_hashmap_insert(cache, p) == 0)
+        {
+          return 1;
+        }
+      pair_free((void **) &p);
+    }
+  long sum = 0;
+  size_t k = 0;
+  unsigned int x = 1;
+  double start = now_sec();
+  for (k = 0; k < lookups; k++)
+    {
+      x = x * 1103515245u + 12345u;
+      int key = (int) (x % entries);
+      sum += *(int *) hashmap_at(map, &key);
+    }
+  double plain = now_sec() - start;
+  x = 1;
+  start = now_sec();
+  for (k = 0; k < lookups; k++)
+    {
+      x = x * 1103515245u + 12345u;
+      int key = (int) (x % entries);
+      sum += *(int *) cache_hashmap_at(cache, &key);
+    }
+  double cached = now_sec() - start;
+  printf("hashmap_at       %8.2f ns/lookup\n", plain * 1e9 / lookups);
+  printf("cache_hashmap_at %8.2f ns/lookup (checksum %ld)\n",
+         cached * 1e9 / lookups, sum);
+  cache_hashmap_free(&cache);
+  hashmap_free(&map);
+  return 0;
+}
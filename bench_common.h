@@ -0,0 +1,47 @@
+/**
+ * Helpers shared by the benchmarks: int keys and values, and a clock.
+ * Each benchmark defines _POSIX_C_SOURCE (or _GNU_SOURCE) before including
+ * it, for clock_gettime.
+ */
+
+#ifndef _BENCH_COMMON_H_
+#define _BENCH_COMMON_H_
+
+#include <stdlib.h>
+#include <time.h>
+
+size_t bench_hash_int (const void *elem)
+{
+  return *((int *) elem);
+}
+
+void *bench_int_cpy (const void *elem)
+{
+  int *new_int = malloc(sizeof(int));
+  if (new_int != NULL)
+    {
+      *new_int = *((int *) elem);
+    }
+  return new_int;
+}
+
+int bench_int_cmp (const void *elem_1, const void *elem_2)
+{
+  return *(int *) elem_1 == *(int *) elem_2;
+}
+
+void bench_int_free (void **elem)
+{
+  free(*elem);
+  *elem = NULL;
+}
+
+// Returns the wall clock time in seconds, from an arbitrary origin.
+double now_sec (void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+#endif //_BENCH_COMMON_H_
@@ -0,0 +1,199 @@
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "bucket_alloc.h"
+
+// From <numaif.h>, spelled out so libnuma is not needed.
+#define MPOL_BIND 2
+#define MPOL_INTERLEAVE 3
+#define MPOL_MF_MOVE (1 << 1)
+#define NODE_MASK_BITS (sizeof(unsigned long) * 8)
+
+// Returns 1 if count elements of elem_size bytes overflow a size_t.
+int array_overflows (size_t count, size_t elem_size)
+{
+  return elem_size != 0 && count > SIZE_MAX / elem_size;
+}
+
+// Returns the mapped length for an array of the given bytes, 0 if the array
+// should come from malloc. Depends on the size only, so the free path always
+// takes the same branch as the allocation did.
+size_t mapped_length (size_t bytes)
+{
+  if (bytes < BUCKET_ALLOC_MMAP_THRESHOLD)
+    {
+      return 0;
+    }
+  return (bytes + BUCKET_ALLOC_HUGE_PAGE_SIZE - 1)
+         & ~(BUCKET_ALLOC_HUGE_PAGE_SIZE - 1);
+}
+
+// Applies a NUMA memory policy on a mapped range.
+// returns 0 if failed, 1 if succeeded
+int apply_mbind (void *ptr, size_t len, int mode, int node, unsigned flags)
+{
+  unsigned long mask = 0;
+  if (mode == MPOL_INTERLEAVE)
+    {
+      mask = ~0UL;
+    }
+  else
+    {
+      if (node < 0 || (size_t) node >= NODE_MASK_BITS)
+        {
+          return 0;
+        }
+      mask = 1UL << node;
+    }
+  long check = syscall(SYS_mbind, ptr, len, mode, &mask, NODE_MASK_BITS + 1,
+                       flags);
+  return check == 0;
+}
+
+// Maps len zeroed bytes according to a policy.
+void *map_array (size_t len, const bucket_policy *policy)
+{
+  void *ptr = MAP_FAILED;
+  if (policy->flags & BUCKET_ALLOC_HUGETLB)
+    {
+      ptr = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    }
+  if (ptr == MAP_FAILED)
+    {
+      // No reserved huge pages, fall back to regular pages.
+      ptr = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (ptr == MAP_FAILED)
+        {
+          return NULL;
+        }
+      if (policy->flags & (BUCKET_ALLOC_HUGE_PAGES | BUCKET_ALLOC_HUGETLB))
+        {
+          madvise(ptr, len, MADV_HUGEPAGE);
+        }
+    }
+  // A policy the kernel refuses (no NUMA support) just leaves first touch.
+  if (policy->flags & BUCKET_ALLOC_NUMA_INTERLEAVE)
+    {
+      apply_mbind(ptr, len, MPOL_INTERLEAVE, 0, 0);
+    }
+  else if (policy->flags & BUCKET_ALLOC_NUMA_BIND)
+    {
+      apply_mbind(ptr, len, MPOL_BIND, policy->node, 0);
+    }
+  return ptr;
+}
+
+/**
+ * Allocates a zeroed array of count elements of elem_size bytes, under the
+ * default policy.
+ * @return pointer to the array, NULL on failure.
+ */
+void *bucket_alloc (size_t count, size_t elem_size)
+{
+  return bucket_alloc_policy(count, elem_size, NULL);
+}
+
+/**
+ * Allocates a zeroed array of count elements of elem_size bytes.
+ * @param policy the policy to map it with, NULL for the default one.
+ * @return pointer to the array, NULL on failure.
+ */
+void *bucket_alloc_policy (size_t count, size_t elem_size,
+                           const bucket_policy *policy)
+{
+  bucket_policy default_policy = {BUCKET_ALLOC_DEFAULT, 0};
+  if (array_overflows(count, elem_size))
+    {
+      return NULL;
+    }
+  size_t len = mapped_length(count * elem_size);
+  if (len == 0)
+    {
+      return calloc(elem_size, count);
+    }
+  if (policy == NULL)
+    {
+      policy = &default_policy;
+    }
+  return map_array(len, policy);
+}
+
+/**
+ * Resizes an array allocated by bucket_alloc.
+ * @return pointer to the resized array, NULL on failure (ptr is left intact).
+ */
+void *bucket_realloc (void *ptr, size_t old_count, size_t new_count,
+                      size_t elem_size)
+{
+  if (array_overflows(new_count, elem_size))
+    {
+      return NULL;
+    }
+  size_t old_len = mapped_length(old_count * elem_size);
+  size_t new_len = mapped_length(new_count * elem_size);
+  if (ptr == NULL)
+    {
+      return bucket_alloc(new_count, elem_size);
+    }
+  if (old_len == 0 && new_len == 0)
+    {
+      return realloc(ptr, new_count * elem_size);
+    }
+  if (old_len == new_len)
+    {
+      return ptr;
+    }
+  void *new_ptr = bucket_alloc(new_count, elem_size);
+  if (new_ptr == NULL)
+    {
+      return NULL;
+    }
+  size_t keep = old_count < new_count ? old_count : new_count;
+  memcpy(new_ptr, ptr, keep * elem_size);
+  bucket_free(ptr, old_count, elem_size);
+  return new_ptr;
+}
+
+/**
+ * Frees an array allocated by bucket_alloc.
+ * @param ptr the array, may be NULL.
+ * @param count the number of elements ptr was allocated with.
+ * @param elem_size the size of a single element.
+ */
+void bucket_free (void *ptr, size_t count, size_t elem_size)
+{
+  if (ptr == NULL)
+    {
+      return;
+    }
+  size_t len = mapped_length(count * elem_size);
+  if (len == 0)
+    {
+      free(ptr);
+      return;
+    }
+  munmap(ptr, len);
+}
+
+/**
+ * Binds (and migrates) an existing mmap backed array to a NUMA node.
+ * @return 1 on success, 0 if the array is malloc backed or mbind failed.
+ */
+int bucket_alloc_bind (void *ptr, size_t count, size_t elem_size, int node)
+{
+  if (array_overflows(count, elem_size))
+    {
+      return 0;
+    }
+  size_t len = mapped_length(count * elem_size);
+  if (ptr == NULL || len == 0)
+    {
+      return 0;
+    }
+  return apply_mbind(ptr, len, MPOL_BIND, node, MPOL_MF_MOVE);
+}
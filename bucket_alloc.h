@@ -0,0 +1,77 @@
+#ifndef BUCKET_ALLOC_H_
+#define BUCKET_ALLOC_H_
+
+#include <stdlib.h>
+
+// Arrays of at least this many bytes are mapped with mmap instead of malloc,
+// rounded up to a whole huge page.
+#define BUCKET_ALLOC_MMAP_THRESHOLD (1UL << 21)
+#define BUCKET_ALLOC_HUGE_PAGE_SIZE (1UL << 21)
+
+// Policy flags, may be combined.
+#define BUCKET_ALLOC_DEFAULT 0
+#define BUCKET_ALLOC_HUGE_PAGES 1
+#define BUCKET_ALLOC_HUGETLB 2
+#define BUCKET_ALLOC_NUMA_INTERLEAVE 4
+#define BUCKET_ALLOC_NUMA_BIND 8
+
+/**
+ * Where and how a bucket array is mapped, e.g. per map or per shard.
+ * flags is a combination of the BUCKET_ALLOC_* flags:
+ * BUCKET_ALLOC_HUGE_PAGES asks for transparent huge pages (madvise),
+ * BUCKET_ALLOC_HUGETLB tries explicit MAP_HUGETLB pages first,
+ * BUCKET_ALLOC_NUMA_INTERLEAVE interleaves pages over all nodes and
+ * BUCKET_ALLOC_NUMA_BIND binds them to node.
+ * Only arrays of at least BUCKET_ALLOC_MMAP_THRESHOLD bytes are affected.
+ */
+typedef struct bucket_policy {
+    int flags;
+    int node;
+} bucket_policy;
+
+/**
+ * Allocates a zeroed array of count elements of elem_size bytes, under the
+ * default policy.
+ * @return pointer to the array, NULL on failure (also if count * elem_size
+ * overflows).
+ */
+void *bucket_alloc (size_t count, size_t elem_size);
+
+/**
+ * Allocates a zeroed array of count elements of elem_size bytes.
+ * @param policy the policy to map it with, NULL for the default one.
+ * @return pointer to the array, NULL on failure (also if count * elem_size
+ * overflows).
+ */
+void *bucket_alloc_policy (size_t count, size_t elem_size,
+                           const bucket_policy *policy);
+
+/**
+ * Resizes an array allocated by bucket_alloc (like realloc, the new tail is
+ * not guaranteed to be zeroed). An array moved to or from mmap is mapped
+ * under the default policy.
+ * @param ptr the array, may be NULL.
+ * @param old_count the number of elements ptr was allocated with.
+ * @param new_count the wanted number of elements.
+ * @param elem_size the size of a single element.
+ * @return pointer to the resized array, NULL on failure (ptr is left intact).
+ */
+void *bucket_realloc (void *ptr, size_t old_count, size_t new_count,
+                      size_t elem_size);
+
+/**
+ * Frees an array allocated by bucket_alloc.
+ * @param ptr the array, may be NULL.
+ * @param count the number of elements ptr was allocated with.
+ * @param elem_size the size of a single element.
+ */
+void bucket_free (void *ptr, size_t count, size_t elem_size);
+
+/**
+ * Binds (and migrates) an existing mmap backed array to a NUMA node, e.g. a
+ * shard's buckets to the node of the thread that serves it.
+ * @return 1 on success, 0 if the array is malloc backed or mbind failed.
+ */
+int bucket_alloc_bind (void *ptr, size_t count, size_t elem_size, int node);
+
+#endif // BUCKET_ALLOC_H_
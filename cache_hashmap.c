@@ -0,0 +1,248 @@
+#include "cache_hashmap.h"
+#include "hashmap_ext.h"
+
+#define CACHE_CLOCK_INITIAL_CAP 16UL
+#define CACHE_CLOCK_GROWTH_FACTOR 2UL
+
+// Value callbacks of the pairs stored in the underlying hashmap. The entry is
+// copied shallowly, the copy owns the user's value from then on.
+void *cache_entry_copy (const_valueT value)
+{
+  cache_entry *entry = malloc(sizeof(cache_entry));
+  if (entry == NULL)
+    {
+      return NULL;
+    }
+  *entry = *((const cache_entry *) value);
+  return entry;
+}
+
+int cache_entry_cmp (const_valueT value_1, const_valueT value_2)
+{
+  const cache_entry *a = value_1;
+  const cache_entry *b = value_2;
+  return a->value_cmp(a->value, b->value);
+}
+
+void cache_entry_free (valueT *value)
+{
+  if (value == NULL || *value == NULL)
+    {
+      return;
+    }
+  cache_entry *entry = *value;
+  entry->value_free(&entry->value);
+  free(entry);
+  *value = NULL;
+}
+
+// Takes an entry off the clock, moving the last one into its slot.
+void cache_unlink (cache_hashmap *cache, cache_entry *entry)
+{
+  cache_entry *last = cache->clock[cache->clock_size - 1];
+  cache->clock[entry->slot] = last;
+  last->slot = entry->slot;
+  cache->clock_size--;
+  if (cache->hand >= cache->clock_size)
+    {
+      cache->hand = 0;
+    }
+  cache->used -= entry->cost;
+}
+
+// Advances the clock hand to the first entry not referenced since the hand
+// last passed it, and evicts it.
+void cache_evict_one (cache_hashmap *cache)
+{
+  while (cache->clock[cache->hand]->referenced)
+    {
+      cache->clock[cache->hand]->referenced = 0;
+      cache->hand = (cache->hand + 1) % cache->clock_size;
+    }
+  cache_entry *victim = cache->clock[cache->hand];
+  keyT key = victim->key;
+  cache_unlink(cache, victim);
+  if (cache->evict_func != NULL)
+    {
+      pair evicted = *hashmap_find(cache->map, key);
+      evicted.value = victim->value;
+      evicted.value_cpy = victim->value_cpy;
+      evicted.value_cmp = victim->value_cmp;
+      evicted.value_free = victim->value_free;
+      cache->evict_func(&evicted, cache->evict_ctx);
+    }
+  hashmap_erase(cache->map, key);
+}
+
+/**
+ * Allocates dynamically new cache.
+ * @param func a function which "hashes" keys.
+ * @param capacity the maximal total cost of the cached pairs.
+ * @param cost_func the cost of a pair, NULL to count every pair as 1.
+ * @param evict_func called with every evicted pair, may be NULL.
+ * @param evict_ctx passed to evict_func as is.
+ * @return pointer to dynamically allocated cache.
+ * @if_fail return NULL.
+ */
+cache_hashmap *cache_hashmap_alloc (hash_func func, size_t capacity,
+                                    cache_cost_func cost_func,
+                                    cache_evict_func evict_func,
+                                    void *evict_ctx)
+{
+  if (func == NULL || capacity == 0)
+    {
+      return NULL;
+    }
+  cache_hashmap *cache = calloc(sizeof(*cache), 1);
+  if (cache == NULL)
+    {
+      return NULL;
+    }
+  cache->map = hashmap_alloc(func);
+  cache->clock = calloc(sizeof(cache_entry *), CACHE_CLOCK_INITIAL_CAP);
+  if (cache->map == NULL || cache->clock == NULL)
+    {
+      cache_hashmap_free(&cache);
+      return NULL;
+    }
+  cache->clock_capacity = CACHE_CLOCK_INITIAL_CAP;
+  cache->capacity = capacity;
+  cache->cost_func = cost_func;
+  cache->evict_func = evict_func;
+  cache->evict_ctx = evict_ctx;
+  return cache;
+}
+
+/**
+ * Frees a cache and all the pairs it holds (without calling evict_func).
+ * @param p_cache pointer to dynamically allocated pointer to cache_hashmap.
+ */
+void cache_hashmap_free (cache_hashmap **p_cache)
+{
+  if (p_cache == NULL || *p_cache == NULL)
+    {
+      return;
+    }
+  if ((*p_cache)->map != NULL)
+    {
+      hashmap_free(&(*p_cache)->map);
+    }
+  free((*p_cache)->clock);
+  free(*p_cache);
+  *p_cache = NULL;
+}
+
+/**
+ * Inserts a copy of in_pair, evicting pairs until it fits. Nothing is
+ * evicted if the insertion fails.
+ * @param cache the cache.
+ * @param in_pair a pair the cache would contain.
+ * @return returns 1 for successful insertion, 0 otherwise.
+ */
+int cache_hashmap_insert (cache_hashmap *cache, const pair *in_pair)
+{
+  if (cache == NULL || in_pair == NULL || in_pair->key == NULL ||
+      in_pair->value == NULL || hashmap_at(cache->map, in_pair->key) != NULL)
+    {
+      return 0;
+    }
+  size_t cost = 1;
+  if (cache->cost_func != NULL)
+    {
+      cost = cache->cost_func(in_pair);
+    }
+  if (cost > cache->capacity)
+    {
+      return 0;
+    }
+  if (cache->clock_size == cache->clock_capacity)
+    {
+      cache_entry **clock = realloc(cache->clock, sizeof(cache_entry *)
+      * cache->clock_capacity * CACHE_CLOCK_GROWTH_FACTOR);
+      if (clock == NULL)
+        {
+          return 0;
+        }
+      cache->clock = clock;
+      cache->clock_capacity *= CACHE_CLOCK_GROWTH_FACTOR;
+    }
+  cache_entry proto = {NULL, NULL, 0, cost, in_pair->value_cpy,
+                       in_pair->value_cmp, in_pair->value_free, 0};
+  proto.value = in_pair->value_cpy(in_pair->value);
+  if (proto.value == NULL)
+    {
+      return 0;
+    }
+  pair wrapped = *in_pair;
+  wrapped.value = &proto;
+  wrapped.value_cpy = cache_entry_copy;
+  wrapped.value_cmp = cache_entry_cmp;
+  wrapped.value_free = cache_entry_free;
+  if (hashmap_insert(cache->map, &wrapped) == 0)
+    {
+      proto.value_free(&proto.value);
+      return 0;
+    }
+  // Nothing is evicted before the insertion can no longer fail. The new
+  // entry is not on the clock yet, so the hand cannot pick it.
+  pair *stored = hashmap_find(cache->map, in_pair->key);
+  cache_entry *entry = stored->value;
+  entry->key = stored->key;
+  while (cache->used + cost > cache->capacity)
+    {
+      cache_evict_one(cache);
+    }
+  entry->slot = cache->clock_size;
+  cache->clock[cache->clock_size] = entry;
+  cache->clock_size++;
+  cache->used += cost;
+  return 1;
+}
+
+/**
+ * Returns the value associated with the given key and marks it as recently
+ * used. Setting the mark is atomic, concurrent lookups are safe.
+ * @param cache the cache.
+ * @param key the key to be checked.
+ * @return the value associated with key if cached, NULL otherwise.
+ */
+valueT cache_hashmap_at (const cache_hashmap *cache, const_keyT key)
+{
+  if (cache == NULL)
+    {
+      return NULL;
+    }
+  cache_entry *entry = hashmap_at(cache->map, key);
+  if (entry == NULL)
+    {
+      return NULL;
+    }
+  // concurrent lookups only race on the bit, and all of them set it; the
+  // load keeps an already set bit's cache line shared
+  if (!__atomic_load_n(&entry->referenced, __ATOMIC_RELAXED))
+    {
+      __atomic_store_n(&entry->referenced, 1, __ATOMIC_RELAXED);
+    }
+  return entry->value;
+}
+
+/**
+ * Erases the pair associated with key (without calling evict_func).
+ * @param cache the cache.
+ * @param key a key of the pair to be erased.
+ * @return 1 if the erasing was done successfully, 0 otherwise.
+ */
+int cache_hashmap_erase (cache_hashmap *cache, const_keyT key)
+{
+  if (cache == NULL)
+    {
+      return 0;
+    }
+  cache_entry *entry = hashmap_at(cache->map, key);
+  if (entry == NULL)
+    {
+      return 0;
+    }
+  cache_unlink(cache, entry);
+  return hashmap_erase(cache->map, key);
+}
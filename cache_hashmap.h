@@ -0,0 +1,112 @@
+#ifndef CACHE_HASHMAP_H_
+#define CACHE_HASHMAP_H_
+
+#include "hashmap.h"
+
+typedef void *(*cache_value_cpy) (const_valueT);
+typedef int (*cache_value_cmp) (const_valueT, const_valueT);
+typedef void (*cache_value_free) (valueT *);
+
+/**
+ * Returns the cost of a pair against the cache capacity, e.g. its size in
+ * bytes.
+ */
+typedef size_t (*cache_cost_func) (const pair *);
+
+/**
+ * Called with every pair the cache evicts, right before it is freed (use
+ * pair_copy to keep it).
+ */
+typedef void (*cache_evict_func) (const pair *, void *);
+
+/**
+ * The value the underlying hashmap holds for every cached pair: the user's
+ * value next to its recency bit and its position on the clock.
+ */
+typedef struct cache_entry {
+    valueT value;
+    keyT key;
+    size_t slot;
+    size_t cost;
+    cache_value_cpy value_cpy;
+    cache_value_cmp value_cmp;
+    cache_value_free value_free;
+    int referenced;
+} cache_entry;
+
+/**
+ * A hashmap bounded by a total cost, evicting with CLOCK (second chance).
+ * A hit only sets the entry's referenced bit, nothing is relinked, so
+ * lookups never write shared structure beyond that bit. When room is
+ * needed, the clock hand clears set bits and evicts the first entry whose
+ * bit is clear.
+ * The referenced bit is set with a relaxed atomic store, so
+ * cache_hashmap_at may run on several threads at once, under the shared
+ * side of a reader-writer lock (or with no lock while nothing writes).
+ * cache_hashmap_insert and cache_hashmap_erase, which evict and relink,
+ * need the lock exclusively.
+ */
+typedef struct cache_hashmap {
+    hashmap *map;
+    cache_entry **clock;
+    size_t clock_size;
+    size_t clock_capacity;
+    size_t hand;
+    size_t used;
+    size_t capacity;
+    cache_cost_func cost_func;
+    cache_evict_func evict_func;
+    void *evict_ctx;
+} cache_hashmap;
+
+/**
+ * Allocates dynamically new cache.
+ * @param func a function which "hashes" keys.
+ * @param capacity the maximal total cost of the cached pairs.
+ * @param cost_func the cost of a pair, NULL to count every pair as 1 (then
+ * capacity is a number of entries).
+ * @param evict_func called with every evicted pair, may be NULL.
+ * @param evict_ctx passed to evict_func as is.
+ * @return pointer to dynamically allocated cache.
+ * @if_fail return NULL.
+ */
+cache_hashmap *cache_hashmap_alloc (hash_func func, size_t capacity,
+                                    cache_cost_func cost_func,
+                                    cache_evict_func evict_func,
+                                    void *evict_ctx);
+
+/**
+ * Frees a cache and all the pairs it holds (without calling evict_func).
+ * @param p_cache pointer to dynamically allocated pointer to cache_hashmap.
+ */
+void cache_hashmap_free (cache_hashmap **p_cache);
+
+/**
+ * Inserts a copy of in_pair, evicting pairs until it fits. Nothing is
+ * evicted if the insertion fails.
+ * @param cache the cache.
+ * @param in_pair a pair the cache would contain.
+ * @return returns 1 for successful insertion, 0 otherwise (key already in
+ * cache, pair costs more than the whole capacity or allocation failure).
+ */
+int cache_hashmap_insert (cache_hashmap *cache, const pair *in_pair);
+
+/**
+ * Returns the value associated with the given key and marks it as recently
+ * used. Setting the mark is atomic, concurrent lookups are safe (see
+ * cache_hashmap).
+ * @param cache the cache.
+ * @param key the key to be checked.
+ * @return the value associated with key if cached, NULL otherwise.
+ */
+valueT cache_hashmap_at (const cache_hashmap *cache, const_keyT key);
+
+/**
+ * Erases the pair associated with key (without calling evict_func).
+ * @param cache the cache.
+ * @param key a key of the pair to be erased.
+ * @return 1 if the erasing was done successfully, 0 otherwise.
+ */
+int cache_hashmap_erase (cache_hashmap *cache, const_keyT key);
+
+#endif // CACHE_HASHMAP_H_
@@ -0,0 +1,314 @@
+#include <string.h>
+#include "compact_hashmap.h"
+#include "slot_layout.h"
+#include "bucket_alloc.h"
+
+char *compact_key (const compact_hashmap *map, uint32_t ind)
+{
+  return map->slots + (size_t) ind * map->stride;
+}
+
+size_t compact_bucket_of (const compact_hashmap *map, const_keyT key)
+{
+  return map->hash_func(key) & (map->capacity - 1);
+}
+
+// Relinks every slot of the pool into the (empty) bucket array. Touches only
+// the 32-bit buckets and links, keys and values stay where they are.
+void compact_rebuild (compact_hashmap *map)
+{
+  memset(map->buckets, 0xFF, map->capacity * sizeof(uint32_t));
+  uint32_t i = 0;
+  for (i = 0; i < map->size; i++)
+    {
+      size_t bucket = compact_bucket_of(map, compact_key(map, i));
+      map->next[i] = map->buckets[bucket];
+      map->buckets[bucket] = i;
+    }
+}
+
+// Changes the number of buckets and relinks the pool.
+// returns 0 if failed, 1 if succeeded
+int compact_resize (compact_hashmap *map, size_t new_capacity)
+{
+  uint32_t *buckets = bucket_realloc(map->buckets, map->capacity,
+                                     new_capacity, sizeof(uint32_t));
+  if (buckets == NULL)
+    {
+      return 0;
+    }
+  map->buckets = buckets;
+  map->capacity = new_capacity;
+  compact_rebuild(map);
+  return 1;
+}
+
+// Changes the number of slots in the pool (never below map->size).
+// returns 0 if failed, 1 if succeeded
+int compact_resize_slots (compact_hashmap *map, size_t new_capacity)
+{
+  uint32_t *next = bucket_alloc(new_capacity, sizeof(uint32_t));
+  char *slots = bucket_alloc(new_capacity, map->stride);
+  if (next == NULL || slots == NULL)
+    {
+      bucket_free(next, new_capacity, sizeof(uint32_t));
+      bucket_free(slots, new_capacity, map->stride);
+      return 0;
+    }
+  memcpy(next, map->next, map->size * sizeof(uint32_t));
+  memcpy(slots, map->slots, map->size * map->stride);
+  bucket_free(map->next, map->slots_capacity, sizeof(uint32_t));
+  bucket_free(map->slots, map->slots_capacity, map->stride);
+  map->next = next;
+  map->slots = slots;
+  map->slots_capacity = new_capacity;
+  return 1;
+}
+
+// Returns the slot holding key, COMPACT_HASHMAP_NIL if none. *prev is set
+// to the slot linking to it (COMPACT_HASHMAP_NIL if it is the chain head).
+uint32_t compact_find (const compact_hashmap *map, const_keyT key,
+                       uint32_t *prev)
+{
+  uint32_t before = COMPACT_HASHMAP_NIL;
+  uint32_t ind = map->buckets[compact_bucket_of(map, key)];
+  while (ind != COMPACT_HASHMAP_NIL)
+    {
+      if (memcmp(compact_key(map, ind), key, map->key_size) == 0)
+        {
+          break;
+        }
+      before = ind;
+      ind = map->next[ind];
+    }
+  if (prev != NULL)
+    {
+      *prev = before;
+    }
+  return ind;
+}
+
+/**
+ * Allocates dynamically new compact hash map.
+ * @param func a function which "hashes" keys.
+ * @param key_size the size in bytes of every key.
+ * @param value_size the size in bytes of every value.
+ * @return pointer to dynamically allocated compact hashmap.
+ * @if_fail return NULL.
+ */
+compact_hashmap *compact_hashmap_alloc (hash_func func, size_t key_size,
+                                        size_t value_size)
+{
+  if (func == NULL || key_size == 0)
+    {
+      return NULL;
+    }
+  compact_hashmap *map = calloc(sizeof(*map), 1);
+  if (map == NULL)
+    {
+      return NULL;
+    }
+  map->key_size = key_size;
+  map->value_size = value_size;
+  slot_layout(key_size, value_size, &map->value_offset, &map->stride);
+  map->hash_func = func;
+  map->capacity = COMPACT_HASHMAP_INITIAL_CAP;
+  map->buckets = bucket_alloc(map->capacity, sizeof(uint32_t));
+  map->next = bucket_alloc(COMPACT_HASHMAP_INITIAL_CAP, sizeof(uint32_t));
+  map->slots = bucket_alloc(COMPACT_HASHMAP_INITIAL_CAP, map->stride);
+  map->slots_capacity = COMPACT_HASHMAP_INITIAL_CAP;
+  if (map->buckets == NULL || map->next == NULL || map->slots == NULL)
+    {
+      compact_hashmap_free(&map);
+      return NULL;
+    }
+  compact_rebuild(map);
+  return map;
+}
+
+/**
+ * Frees a compact hash map.
+ * @param p_map pointer to dynamically allocated pointer to compact_hashmap.
+ */
+void compact_hashmap_free (compact_hashmap **p_map)
+{
+  if (p_map == NULL || *p_map == NULL)
+    {
+      return;
+    }
+  compact_hashmap *map = *p_map;
+  bucket_free(map->buckets, map->capacity, sizeof(uint32_t));
+  bucket_free(map->next, map->slots_capacity, sizeof(uint32_t));
+  bucket_free(map->slots, map->slots_capacity, map->stride);
+  free(map);
+  *p_map = NULL;
+}
+
+/**
+ * Inserts a copy of key_size bytes of key and value_size bytes of value.
+ * @param map the compact hash map.
+ * @param key the key.
+ * @param value the value.
+ * @return returns 1 for successful insertion, 0 otherwise.
+ */
+int compact_hashmap_insert (compact_hashmap *map, const_keyT key,
+                            const_valueT value)
+{
+  if (map == NULL || key == NULL || (value == NULL && map->value_size > 0)
+      || map->size >= COMPACT_HASHMAP_MAX_SIZE
+      || compact_find(map, key, NULL) != COMPACT_HASHMAP_NIL)
+    {
+      return 0;
+    }
+  if ((map->size + 1.0) / map->capacity > COMPACT_HASHMAP_MAX_LOAD_FACTOR)
+    {
+      if (compact_resize(map, map->capacity * COMPACT_HASHMAP_GROWTH_FACTOR)
+          == 0)
+        {
+          return 0;
+        }
+    }
+  if (map->size == map->slots_capacity)
+    {
+      size_t new_capacity = map->slots_capacity * COMPACT_HASHMAP_GROWTH_FACTOR;
+      if (new_capacity > COMPACT_HASHMAP_MAX_SIZE)
+        {
+          new_capacity = COMPACT_HASHMAP_MAX_SIZE;
+        }
+      if (compact_resize_slots(map, new_capacity) == 0)
+        {
+          return 0;
+        }
+    }
+  uint32_t ind = (uint32_t) map->size;
+  char *slot = compact_key(map, ind);
+  memcpy(slot, key, map->key_size);
+  if (map->value_size > 0)
+    {
+      memcpy(slot + map->value_offset, value, map->value_size);
+    }
+  size_t bucket = compact_bucket_of(map, slot);
+  map->next[ind] = map->buckets[bucket];
+  map->buckets[bucket] = ind;
+  map->size++;
+  return 1;
+}
+
+/**
+ * The function returns the value associated with the given key.
+ * @param map a compact hash map.
+ * @param key the key to be checked.
+ * @return pointer to the value inside the pool if exists, NULL otherwise.
+ */
+valueT compact_hashmap_at (const compact_hashmap *map, const_keyT key)
+{
+  if (map == NULL || key == NULL)
+    {
+      return NULL;
+    }
+  uint32_t ind = compact_find(map, key, NULL);
+  if (ind == COMPACT_HASHMAP_NIL)
+    {
+      return NULL;
+    }
+  return compact_key(map, ind) + map->value_offset;
+}
+
+/**
+ * The function erases the pair associated with key.
+ * @param map a compact hash map.
+ * @param key a key of the pair to be erased.
+ * @return 1 if the erasing was done successfully, 0 otherwise.
+ */
+int compact_hashmap_erase (compact_hashmap *map, const_keyT key)
+{
+  if (map == NULL || key == NULL)
+    {
+      return 0;
+    }
+  uint32_t prev = COMPACT_HASHMAP_NIL;
+  uint32_t ind = compact_find(map, key, &prev);
+  if (ind == COMPACT_HASHMAP_NIL)
+    {
+      return 0;
+    }
+  if (prev == COMPACT_HASHMAP_NIL)
+    {
+      map->buckets[compact_bucket_of(map, key)] = map->next[ind];
+    }
+  else
+    {
+      map->next[prev] = map->next[ind];
+    }
+  // Move the last slot into the hole so the pool stays dense.
+  uint32_t last = (uint32_t) (map->size - 1);
+  if (ind != last)
+    {
+      uint32_t *link = &map->buckets[compact_bucket_of(map,
+                                                       compact_key(map, last))];
+      while (*link != last)
+        {
+          link = &map->next[*link];
+        }
+      *link = ind;
+      memcpy(compact_key(map, ind), compact_key(map, last), map->stride);
+      map->next[ind] = map->next[last];
+    }
+  map->size--;
+  // Shrinking is best effort, a failure leaves a valid (larger) map.
+  if ((double) map->size / map->capacity < COMPACT_HASHMAP_MIN_LOAD_FACTOR
+      && map->capacity > COMPACT_HASHMAP_INITIAL_CAP)
+    {
+      compact_resize(map, map->capacity / COMPACT_HASHMAP_GROWTH_FACTOR);
+    }
+  if (map->size * 4 < map->slots_capacity
+      && map->slots_capacity > COMPACT_HASHMAP_INITIAL_CAP)
+    {
+      compact_resize_slots(map,
+                           map->slots_capacity / COMPACT_HASHMAP_GROWTH_FACTOR);
+    }
+  return 1;
+}
+
+/**
+ * This function returns the load factor of the compact hash map.
+ * @param map a compact hash map.
+ * @return the map's load factor, -1 if the function failed.
+ */
+double compact_hashmap_get_load_factor (const compact_hashmap *map)
+{
+  if (map == NULL || map->capacity < 1)
+    {
+      return -1;
+    }
+  double cap = map->capacity;
+  return map->size / cap;
+}
+
+/**
+ * Applies valT_func on every value whose key meets keyT_func.
+ * @param map a compact hash map.
+ * @param keyT_func a function that checks a condition on keyT.
+ * @param valT_func a function that modifies valueT, in-place.
+ * @return number of changed values, -1 on invalid arguments.
+ */
+int compact_hashmap_apply_if (const compact_hashmap *map, keyT_func keyT_func,
+                              valueT_func valT_func)
+{
+  if (map == NULL || keyT_func == NULL || valT_func == NULL)
+    {
+      return -1;
+    }
+  int counter = 0;
+  uint32_t i = 0;
+  for (i = 0; i < map->size; i++)
+    {
+      char *slot = compact_key(map, i);
+      if (keyT_func(slot) == 1)
+        {
+          counter++;
+          valT_func(slot + map->value_offset);
+        }
+    }
+  return counter;
+}
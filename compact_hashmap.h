@@ -0,0 +1,100 @@
+#ifndef COMPACT_HASHMAP_H_
+#define COMPACT_HASHMAP_H_
+
+#include <stdint.h>
+#include "hashmap.h"
+
+#define COMPACT_HASHMAP_INITIAL_CAP 16UL
+#define COMPACT_HASHMAP_GROWTH_FACTOR 2UL
+#define COMPACT_HASHMAP_MAX_LOAD_FACTOR 0.75
+#define COMPACT_HASHMAP_MIN_LOAD_FACTOR 0.25
+#define COMPACT_HASHMAP_NIL UINT32_MAX
+#define COMPACT_HASHMAP_MAX_SIZE ((size_t) UINT32_MAX - 1)
+
+/**
+ * A hash map for fixed size keys and values (ints, doubles, POD structs)
+ * holding up to COMPACT_HASHMAP_MAX_SIZE pairs without a single pointer per
+ * pair. Keys and values are copied by value into one pooled slot array, the
+ * buckets and the chain links are 32-bit slot indices, so a pair costs its
+ * raw bytes plus about 9 bytes (a 4 byte link and 4 byte buckets at the
+ * maximal load factor). The pool is kept dense: erasing moves the last slot
+ * into the hole.
+ * Keys are compared bytewise.
+ */
+typedef struct compact_hashmap {
+    uint32_t *buckets;
+    uint32_t *next;
+    char *slots;
+    size_t capacity;
+    size_t size;
+    size_t slots_capacity;
+    size_t key_size;
+    size_t value_offset;
+    size_t value_size;
+    size_t stride;
+    hash_func hash_func;
+} compact_hashmap;
+
+/**
+ * Allocates dynamically new compact hash map.
+ * @param func a function which "hashes" keys.
+ * @param key_size the size in bytes of every key.
+ * @param value_size the size in bytes of every value.
+ * @return pointer to dynamically allocated compact hashmap.
+ * @if_fail return NULL.
+ */
+compact_hashmap *compact_hashmap_alloc (hash_func func, size_t key_size,
+                                        size_t value_size);
+
+/**
+ * Frees a compact hash map.
+ * @param p_map pointer to dynamically allocated pointer to compact_hashmap.
+ */
+void compact_hashmap_free (compact_hashmap **p_map);
+
+/**
+ * Inserts a copy of key_size bytes of key and value_size bytes of value.
+ * @param map the compact hash map.
+ * @param key the key.
+ * @param value the value.
+ * @return returns 1 for successful insertion, 0 otherwise (key already in
+ * map, map full or allocation failure).
+ */
+int compact_hashmap_insert (compact_hashmap *map, const_keyT key,
+                            const_valueT value);
+
+/**
+ * The function returns the value associated with the given key.
+ * @param map a compact hash map.
+ * @param key the key to be checked.
+ * @return pointer to the value inside the pool if exists, NULL otherwise.
+ * The pointer is valid until the next insert or erase.
+ */
+valueT compact_hashmap_at (const compact_hashmap *map, const_keyT key);
+
+/**
+ * The function erases the pair associated with key.
+ * @param map a compact hash map.
+ * @param key a key of the pair to be erased.
+ * @return 1 if the erasing was done successfully, 0 otherwise.
+ */
+int compact_hashmap_erase (compact_hashmap *map, const_keyT key);
+
+/**
+ * This function returns the load factor of the compact hash map.
+ * @param map a compact hash map.
+ * @return the map's load factor, -1 if the function failed.
+ */
+double compact_hashmap_get_load_factor (const compact_hashmap *map);
+
+/**
+ * Applies valT_func on every value whose key meets keyT_func.
+ * @param map a compact hash map.
+ * @param keyT_func a function that checks a condition on keyT.
+ * @param valT_func a function that modifies valueT, in-place.
+ * @return number of changed values, -1 on invalid arguments.
+ */
+int compact_hashmap_apply_if (const compact_hashmap *map, keyT_func keyT_func,
+                              valueT_func valT_func);
+
+#endif // COMPACT_HASHMAP_H_
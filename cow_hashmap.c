@@ -0,0 +1,641 @@
+#include <string.h>
+#include "cow_hashmap.h"
+#include "hashmap_bucket.h"
+
+// Returns the number of bucket pointers per segment of a table.
+size_t cow_segment_len (const cow_table *table)
+{
+  if (table->capacity < COW_SEGMENT_BUCKETS)
+    {
+      return table->capacity;
+    }
+  return COW_SEGMENT_BUCKETS;
+}
+
+// Returns the slot of bucket ind of a table.
+vector **cow_bucket (const cow_table *table, size_t ind)
+{
+  size_t len = cow_segment_len(table);
+  return &table->segments[ind / len][ind % len];
+}
+
+// Returns 1 if other holds the very segment s of table.
+int cow_holds_segment (const cow_table *other, const cow_table *table,
+                       size_t s)
+{
+  return other != NULL && other->capacity == table->capacity
+         && other->segments[s] == table->segments[s];
+}
+
+// Returns 1 if other holds the very vector table holds at bucket ind.
+int cow_holds (const cow_table *other, const cow_table *table, size_t ind)
+{
+  return other != NULL && other->capacity == table->capacity
+         && *cow_bucket(other, ind) == *cow_bucket(table, ind);
+}
+
+// Frees a table no one reads any more, with the segments and vectors
+// neither of the neighbouring tables still holds. A segment or a vector is
+// only ever held by a run of consecutive tables, so checking the
+// neighbours is enough.
+void cow_table_free (cow_table *table, const cow_table *older,
+                     const cow_table *newer)
+{
+  size_t len = cow_segment_len(table);
+  size_t s = 0;
+  size_t i = 0;
+  for (s = 0; s < table->segment_count; s++)
+    {
+      if (table->segments[s] == NULL || cow_holds_segment(older, table, s)
+          || cow_holds_segment(newer, table, s))
+        {
+          continue;
+        }
+      for (i = s * len; i < (s + 1) * len; i++)
+        {
+          if (*cow_bucket(table, i) != NULL && !cow_holds(older, table, i)
+              && !cow_holds(newer, table, i))
+            {
+              vector_free(cow_bucket(table, i));
+            }
+        }
+      free(table->segments[s]);
+    }
+  free(table->segments);
+  free(table);
+}
+
+// Allocates a table of capacity (a power of two) empty buckets.
+cow_table *cow_table_alloc (hash_func func, size_t capacity)
+{
+  cow_table *table = calloc(sizeof(*table), 1);
+  if (table == NULL)
+    {
+      return NULL;
+    }
+  table->capacity = capacity;
+  table->hash_func = func;
+  size_t len = cow_segment_len(table);
+  table->segment_count = capacity / len;
+  table->segments = calloc(sizeof(vector **), table->segment_count);
+  if (table->segments == NULL)
+    {
+      free(table);
+      return NULL;
+    }
+  size_t s = 0;
+  for (s = 0; s < table->segment_count; s++)
+    {
+      table->segments[s] = calloc(sizeof(vector *), len);
+      if (table->segments[s] == NULL)
+        {
+          cow_table_free(table, NULL, NULL);
+          return NULL;
+        }
+    }
+  return table;
+}
+
+// Returns the position of key in its bucket of a table (hash is the full
+// hash of key), -1 if it is not there.
+int cow_find (const cow_table *table, size_t hash, const_keyT key)
+{
+  return find_in_bucket(*cow_bucket(table, hash & (table->capacity - 1)),
+                        hash, key);
+}
+
+// Stores a pair at the back of a bucket, growing its slot array as
+// vector_push_back would, and keeps the bucket sorted.
+// returns 0 if failed, 1 if succeeded
+int cow_push (vector *bucket, pair *stored)
+{
+  if (bucket->size + 1 > bucket->capacity * VECTOR_MAX_LOAD_FACTOR)
+    {
+      size_t cap = bucket->capacity * VECTOR_GROWTH_FACTOR;
+      void **data = realloc(bucket->data, sizeof(void *) * cap);
+      if (data == NULL)
+        {
+          return 0;
+        }
+      bucket->data = data;
+      bucket->capacity = cap;
+    }
+  bucket->data[bucket->size] = stored;
+  bucket->size++;
+  sort_chain(bucket);
+  return 1;
+}
+
+// Returns the value of key in a table, NULL if it is not there.
+const_valueT cow_table_at (const cow_table *table, const_keyT key)
+{
+  size_t hash = table->hash_func(key);
+  int j = cow_find(table, hash, key);
+  if (j == -1)
+    {
+      return NULL;
+    }
+  const vector *bucket = *cow_bucket(table, hash & (table->capacity - 1));
+  return ((const pair *) bucket->data[j])->value;
+}
+
+// Returns the table of the newest snapshot, the one the live table may
+// share segments and buckets with. NULL if there is none.
+const cow_table *cow_shared (const cow_hashmap *map)
+{
+  if (map->newest == NULL)
+    {
+      return NULL;
+    }
+  return map->newest->table;
+}
+
+// Gives the live map its own array of segment pointers once the newest
+// snapshot took the old one. Only the segment_count pointers are copied,
+// the segments themselves stay shared.
+// returns 0 if failed, 1 if succeeded
+int cow_detach (cow_hashmap *map)
+{
+  if (cow_shared(map) != map->table)
+    {
+      return 1;
+    }
+  cow_table *table = calloc(sizeof(*table), 1);
+  if (table == NULL)
+    {
+      return 0;
+    }
+  *table = *map->table;
+  table->segments = malloc(table->segment_count * sizeof(vector **));
+  if (table->segments == NULL)
+    {
+      free(table);
+      return 0;
+    }
+  memcpy(table->segments, map->table->segments,
+         table->segment_count * sizeof(vector **));
+  map->table = table;
+  return 1;
+}
+
+// Makes bucket ind of the live table its own: copies its segment, then the
+// bucket itself (its pairs deep copied), each only if the newest snapshot
+// still holds it. The live table must be detached.
+// returns 0 if failed, 1 if succeeded
+int cow_unshare (cow_hashmap *map, size_t ind)
+{
+  cow_table *table = map->table;
+  const cow_table *shared = cow_shared(map);
+  size_t len = cow_segment_len(table);
+  size_t s = ind / len;
+  if (cow_holds_segment(shared, table, s))
+    {
+      vector **segment = malloc(len * sizeof(vector *));
+      if (segment == NULL)
+        {
+          return 0;
+        }
+      memcpy(segment, table->segments[s], len * sizeof(vector *));
+      table->segments[s] = segment;
+    }
+  vector **slot = cow_bucket(table, ind);
+  if (*slot == NULL || !cow_holds(shared, table, ind))
+    {
+      return 1;
+    }
+  vector *copy = vector_alloc(pair_copy, pair_cmp, pair_free);
+  size_t j = 0;
+  for (j = 0; copy != NULL && j < (*slot)->size; j++)
+    {
+      // the copy keeps the order, and so the sorting, of the original
+      pair *a = hashed_pair_copy((*slot)->data[j], get_hash(*slot, j));
+      if (a == NULL || cow_push(copy, a) == 0)
+        {
+          if (a != NULL)
+            {
+              pair_free((void **) &a);
+            }
+          vector_free(&copy);
+        }
+    }
+  if (copy == NULL)
+    {
+      return 0;
+    }
+  *slot = copy;
+  return 1;
+}
+
+// Gives every bucket of a table being built slots for the pairs counted in
+// its size, and resets the sizes. Sizes are reset even if an allocation
+// failed, so the table can be freed.
+// returns 0 if failed, 1 if succeeded
+int cow_reserve_buckets (cow_table *table)
+{
+  int check = 1;
+  size_t i = 0;
+  for (i = 0; i < table->capacity; i++)
+    {
+      vector *target = *cow_bucket(table, i);
+      if (target == NULL)
+        {
+          continue;
+        }
+      size_t cap = target->capacity;
+      while (target->size > cap * VECTOR_MAX_LOAD_FACTOR)
+        {
+          cap = cap * VECTOR_GROWTH_FACTOR;
+        }
+      target->size = 0;
+      if (check && cap != target->capacity)
+        {
+          void **data = realloc(target->data, sizeof(void *) * cap);
+          check = data != NULL;
+          if (check)
+            {
+              target->data = data;
+              target->capacity = cap;
+            }
+        }
+    }
+  return check;
+}
+
+// Grows the live table to twice its capacity. The pairs of the buckets the
+// newest snapshot still holds are copied, the others are moved. Every new
+// bucket gets its slots up front and the copies are made first, so once
+// pairs move nothing can fail.
+// returns 0 if failed, 1 if succeeded
+int cow_grow (cow_hashmap *map)
+{
+  cow_table *old = map->table;
+  const cow_table *shared = cow_shared(map);
+  cow_table *table = cow_table_alloc(old->hash_func,
+                                     old->capacity * HASH_MAP_GROWTH_FACTOR);
+  if (table == NULL)
+    {
+      return 0;
+    }
+  int check = 1;
+  size_t i = 0;
+  size_t j = 0;
+  for (i = 0; check && i < old->capacity; i++)
+    {
+      const vector *bucket = *cow_bucket(old, i);
+      for (j = 0; check && bucket != NULL && j < bucket->size; j++)
+        {
+          vector **target = cow_bucket(table, get_hash(bucket, j)
+                                              & (table->capacity - 1));
+          if (*target == NULL)
+            {
+              *target = vector_alloc(pair_copy, pair_cmp, pair_free);
+            }
+          check = *target != NULL;
+          if (check)
+            {
+              (*target)->size++;
+            }
+        }
+    }
+  check = cow_reserve_buckets(table) && check;
+  for (i = 0; check && i < old->capacity; i++)
+    {
+      const vector *bucket = *cow_bucket(old, i);
+      if (bucket == NULL || !cow_holds(shared, old, i))
+        {
+          continue;
+        }
+      for (j = 0; check && j < bucket->size; j++)
+        {
+          size_t hash = get_hash(bucket, j);
+          vector *target = *cow_bucket(table,
+                                       hash & (table->capacity - 1));
+          target->data[target->size] = hashed_pair_copy(bucket->data[j],
+                                                        hash);
+          check = target->data[target->size] != NULL;
+          target->size += (size_t) check;
+          if (check)
+            {
+              sort_chain(target);
+            }
+        }
+    }
+  if (!check)
+    {
+      // only copies were made, freeing them leaves the old table as it was
+      cow_table_free(table, NULL, NULL);
+      return 0;
+    }
+  for (i = 0; i < old->capacity; i++)
+    {
+      vector *bucket = *cow_bucket(old, i);
+      if (bucket == NULL || cow_holds(shared, old, i))
+        {
+          continue;
+        }
+      for (j = 0; j < bucket->size; j++)
+        {
+          vector *target = *cow_bucket(table, get_hash(bucket, j)
+                                              & (table->capacity - 1));
+          target->data[target->size] = bucket->data[j];
+          target->size++;
+          sort_chain(target);
+        }
+      // the pairs live on in table, freeing old frees only the vector
+      bucket->size = 0;
+    }
+  table->size = old->size;
+  map->table = table;
+  if (old != shared)
+    {
+      cow_table_free(old, shared, NULL);
+    }
+  return 1;
+}
+
+// Prepares the live table for a write to the key of the given hash,
+// growing it first if adding a pair passes the maximal load factor.
+// returns 0 if failed, 1 if succeeded
+int cow_prepare (cow_hashmap *map, size_t hash, int add)
+{
+  const cow_table *table = map->table;
+  if (add > 0 && (double) (table->size + 1) / (double) table->capacity
+                 > HASH_MAP_MAX_LOAD_FACTOR && cow_grow(map) == 0)
+    {
+      return 0;
+    }
+  return cow_detach(map)
+         && cow_unshare(map, hash & (map->table->capacity - 1));
+}
+
+/**
+ * Allocates dynamically new copy on write hash map.
+ * @param func a function which "hashes" keys.
+ * @return pointer to dynamically allocated cow_hashmap.
+ * @if_fail return NULL.
+ */
+cow_hashmap *cow_hashmap_alloc (hash_func func)
+{
+  if (func == NULL)
+    {
+      return NULL;
+    }
+  cow_hashmap *map = calloc(sizeof(*map), 1);
+  if (map == NULL)
+    {
+      return NULL;
+    }
+  map->table = cow_table_alloc(func, HASH_MAP_INITIAL_CAP);
+  if (map->table == NULL || pthread_mutex_init(&map->lock, NULL) != 0)
+    {
+      if (map->table != NULL)
+        {
+          cow_table_free(map->table, NULL, NULL);
+        }
+      free(map);
+      return NULL;
+    }
+  return map;
+}
+
+/**
+ * Frees a copy on write hash map. Snapshots still held stay readable.
+ * @param p_map pointer to dynamically allocated pointer to cow_hashmap.
+ */
+void cow_hashmap_free (cow_hashmap **p_map)
+{
+  if (p_map == NULL || *p_map == NULL)
+    {
+      return;
+    }
+  cow_hashmap *map = *p_map;
+  *p_map = NULL;
+  pthread_mutex_lock(&map->lock);
+  if (cow_shared(map) != map->table)
+    {
+      cow_table_free(map->table, cow_shared(map), NULL);
+    }
+  map->table = NULL;
+  map->closed = 1;
+  int last = map->newest == NULL;
+  pthread_mutex_unlock(&map->lock);
+  if (last)
+    {
+      pthread_mutex_destroy(&map->lock);
+      free(map);
+    }
+}
+
+/**
+ * Inserts a copy of in_pair (see hashmap_insert).
+ * @return returns 1 for successful insertion, 0 otherwise.
+ */
+int cow_hashmap_insert (cow_hashmap *map, const pair *in_pair)
+{
+  if (map == NULL || in_pair == NULL || in_pair->key == NULL
+      || in_pair->value == NULL)
+    {
+      return 0;
+    }
+  pthread_mutex_lock(&map->lock);
+  size_t hash = map->table->hash_func(in_pair->key);
+  int check = cow_find(map->table, hash, in_pair->key) == -1
+              && cow_prepare(map, hash, 1);
+  if (check)
+    {
+      cow_table *table = map->table;
+      vector **slot = cow_bucket(table, hash & (table->capacity - 1));
+      if (*slot == NULL)
+        {
+          *slot = vector_alloc(pair_copy, pair_cmp, pair_free);
+        }
+      pair *stored = NULL;
+      if (*slot != NULL)
+        {
+          stored = hashed_pair_copy(in_pair, hash);
+        }
+      check = stored != NULL && cow_push(*slot, stored);
+      if (stored != NULL && !check)
+        {
+          pair_free((void **) &stored);
+        }
+      table->size += (size_t) check;
+    }
+  pthread_mutex_unlock(&map->lock);
+  return check;
+}
+
+/**
+ * The function returns the value associated with the given key.
+ * @return the value associated with key if exists, NULL otherwise.
+ */
+const_valueT cow_hashmap_at (const cow_hashmap *map, const_keyT key)
+{
+  if (map == NULL || key == NULL)
+    {
+      return NULL;
+    }
+  return cow_table_at(map->table, key);
+}
+
+/**
+ * The function erases the pair associated with key.
+ * @return 1 if the erasing was done successfully, 0 otherwise.
+ */
+int cow_hashmap_erase (cow_hashmap *map, const_keyT key)
+{
+  if (map == NULL || key == NULL)
+    {
+      return 0;
+    }
+  pthread_mutex_lock(&map->lock);
+  size_t hash = map->table->hash_func(key);
+  // an unshared bucket is a copy, the pair keeps its position
+  int j = cow_find(map->table, hash, key);
+  int check = j != -1 && cow_prepare(map, hash, 0);
+  if (check)
+    {
+      cow_table *table = map->table;
+      vector *bucket = *cow_bucket(table, hash & (table->capacity - 1));
+      bucket->elem_free_func(&bucket->data[j]);
+      memmove(&bucket->data[j], &bucket->data[j + 1],
+              (bucket->size - (size_t) j - 1) * sizeof(void *));
+      bucket->size--;
+      bucket->data[bucket->size] = NULL;
+      table->size--;
+    }
+  pthread_mutex_unlock(&map->lock);
+  return check;
+}
+
+/**
+ * Takes a snapshot of the map in O(1).
+ * @param map a copy on write hash map.
+ * @return the snapshot, release it with cow_snapshot_release.
+ * @if_fail return NULL.
+ */
+cow_snapshot *hashmap_snapshot (cow_hashmap *map)
+{
+  if (map == NULL)
+    {
+      return NULL;
+    }
+  pthread_mutex_lock(&map->lock);
+  cow_snapshot *snapshot = map->newest;
+  if (snapshot != NULL && snapshot->table == map->table)
+    {
+      // nothing was written since, the newest snapshot is still current
+      snapshot->readers++;
+      pthread_mutex_unlock(&map->lock);
+      return snapshot;
+    }
+  snapshot = calloc(sizeof(*snapshot), 1);
+  if (snapshot != NULL)
+    {
+      snapshot->table = map->table;
+      snapshot->owner = map;
+      snapshot->older = map->newest;
+      snapshot->readers = 1;
+      if (map->newest != NULL)
+        {
+          map->newest->newer = snapshot;
+        }
+      map->newest = snapshot;
+    }
+  pthread_mutex_unlock(&map->lock);
+  return snapshot;
+}
+
+/**
+ * The function returns the value associated with the given key at the time
+ * the snapshot was taken.
+ * @return the value associated with key if exists, NULL otherwise.
+ */
+const_valueT cow_snapshot_at (const cow_snapshot *snapshot, const_keyT key)
+{
+  if (snapshot == NULL || key == NULL)
+    {
+      return NULL;
+    }
+  return cow_table_at(snapshot->table, key);
+}
+
+/**
+ * @param snapshot a snapshot.
+ * @return the number of pairs the map held when it was taken.
+ */
+size_t cow_snapshot_size (const cow_snapshot *snapshot)
+{
+  if (snapshot == NULL)
+    {
+      return 0;
+    }
+  return snapshot->table->size;
+}
+
+/**
+ * Adds a reader to a snapshot.
+ * @return snapshot.
+ */
+cow_snapshot *cow_snapshot_retain (cow_snapshot *snapshot)
+{
+  if (snapshot == NULL)
+    {
+      return NULL;
+    }
+  pthread_mutex_lock(&snapshot->owner->lock);
+  snapshot->readers++;
+  pthread_mutex_unlock(&snapshot->owner->lock);
+  return snapshot;
+}
+
+/**
+ * Drops one reader of a snapshot and frees it after its last reader.
+ * @param p_snapshot pointer to a pointer to a snapshot, set to NULL.
+ */
+void cow_snapshot_release (cow_snapshot **p_snapshot)
+{
+  if (p_snapshot == NULL || *p_snapshot == NULL)
+    {
+      return;
+    }
+  cow_snapshot *snapshot = *p_snapshot;
+  cow_hashmap *owner = snapshot->owner;
+  *p_snapshot = NULL;
+  pthread_mutex_lock(&owner->lock);
+  snapshot->readers--;
+  if (snapshot->readers > 0)
+    {
+      pthread_mutex_unlock(&owner->lock);
+      return;
+    }
+  const cow_table *older = NULL;
+  const cow_table *newer = owner->table;
+  if (snapshot->older != NULL)
+    {
+      snapshot->older->newer = snapshot->newer;
+      older = snapshot->older->table;
+    }
+  if (snapshot->newer != NULL)
+    {
+      snapshot->newer->older = snapshot->older;
+      newer = snapshot->newer->table;
+    }
+  else
+    {
+      owner->newest = snapshot->older;
+    }
+  // a table the live map still writes to is not the snapshot's to free
+  if (snapshot->table != owner->table)
+    {
+      cow_table_free(snapshot->table, older, newer);
+    }
+  free(snapshot);
+  int last = owner->closed && owner->newest == NULL;
+  pthread_mutex_unlock(&owner->lock);
+  if (last)
+    {
+      pthread_mutex_destroy(&owner->lock);
+      free(owner);
+    }
+}
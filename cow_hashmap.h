@@ -0,0 +1,134 @@
+#ifndef COW_HASHMAP_H_
+#define COW_HASHMAP_H_
+
+#include <pthread.h>
+#include "hashmap.h"
+
+// The number of bucket pointers per segment of a cow_table (a power of two).
+#define COW_SEGMENT_BUCKETS 256UL
+
+/**
+ * The buckets of a cow_hashmap. The array of bucket pointers is split into
+ * segments of COW_SEGMENT_BUCKETS pointers (a single shorter one while the
+ * table is smaller), which tables of neighbouring snapshots share until a
+ * write copies the one it touches. A bucket is laid out and searched as in
+ * hashmap, by the helpers of hashmap_bucket.h.
+ */
+typedef struct cow_table {
+    vector ***segments;
+    size_t segment_count;
+    size_t size;
+    size_t capacity;
+    hash_func hash_func;
+} cow_table;
+
+struct cow_hashmap;
+
+/**
+ * A read-only view of a cow_hashmap at the time it was taken. Read it with
+ * cow_snapshot_at and cow_snapshot_size from any thread. Snapshots of one
+ * map are linked oldest to newest; the segments and buckets a snapshot
+ * shares with its neighbours are freed by the last of them.
+ */
+typedef struct cow_snapshot {
+    cow_table *table;
+    struct cow_hashmap *owner;
+    struct cow_snapshot *older;
+    struct cow_snapshot *newer;
+    size_t readers;
+} cow_snapshot;
+
+/**
+ * A hashmap whose snapshots share its buckets (copy on write).
+ * Taking a snapshot hands it the live table in O(1). The first write after
+ * that copies the short array of segment pointers, and every segment (of
+ * COW_SEGMENT_BUCKETS bucket pointers) and every bucket (its pairs deep
+ * copied) is then copied only when a write first touches it. A write that
+ * grows the table copies the pairs still shared and moves the others.
+ * One thread writes; snapshots can be read and released from any thread.
+ * This is a map type of its own, not snapshots of hashmap itself: every
+ * write path of hashmap (insert, erase, rehash, merge, compact and the
+ * multimap operations) edits buckets in place and would each need the
+ * copy on write checks. Only the bucket layout and search are shared.
+ */
+typedef struct cow_hashmap {
+    cow_table *table;
+    cow_snapshot *newest;
+    pthread_mutex_t lock;
+    int closed;
+} cow_hashmap;
+
+/**
+ * Allocates dynamically new copy on write hash map.
+ * @param func a function which "hashes" keys.
+ * @return pointer to dynamically allocated cow_hashmap.
+ * @if_fail return NULL.
+ */
+cow_hashmap *cow_hashmap_alloc (hash_func func);
+
+/**
+ * Frees a copy on write hash map. Snapshots still held stay readable, the
+ * memory they share is released with the last of them.
+ * @param p_map pointer to dynamically allocated pointer to cow_hashmap.
+ */
+void cow_hashmap_free (cow_hashmap **p_map);
+
+/**
+ * Inserts a copy of in_pair (see hashmap_insert).
+ * @return returns 1 for successful insertion, 0 otherwise.
+ */
+int cow_hashmap_insert (cow_hashmap *map, const pair *in_pair);
+
+/**
+ * The function returns the value associated with the given key, read from
+ * the writing thread. The value may be shared with a snapshot, change it
+ * through erase and insert.
+ * @return the value associated with key if exists, NULL otherwise.
+ */
+const_valueT cow_hashmap_at (const cow_hashmap *map, const_keyT key);
+
+/**
+ * The function erases the pair associated with key. The table never
+ * shrinks, the bucket array of a snapshot is never moved.
+ * @return 1 if the erasing was done successfully, 0 otherwise.
+ */
+int cow_hashmap_erase (cow_hashmap *map, const_keyT key);
+
+/**
+ * Takes a snapshot of the map in O(1). Without writes in between, the
+ * previous snapshot is returned again with one more reader.
+ * @param map a copy on write hash map.
+ * @return the snapshot, release it with cow_snapshot_release.
+ * @if_fail return NULL.
+ */
+cow_snapshot *hashmap_snapshot (cow_hashmap *map);
+
+/**
+ * The function returns the value associated with the given key at the time
+ * the snapshot was taken.
+ * @param snapshot a snapshot.
+ * @param key the key to be checked.
+ * @return the value associated with key if exists, NULL otherwise.
+ */
+const_valueT cow_snapshot_at (const cow_snapshot *snapshot, const_keyT key);
+
+/**
+ * @param snapshot a snapshot.
+ * @return the number of pairs the map held when it was taken, 0 if
+ * snapshot is NULL.
+ */
+size_t cow_snapshot_size (const cow_snapshot *snapshot);
+
+/**
+ * Adds a reader to a snapshot, e.g. before handing it to another thread.
+ * @return snapshot.
+ */
+cow_snapshot *cow_snapshot_retain (cow_snapshot *snapshot);
+
+/**
+ * Drops one reader of a snapshot and frees it after its last reader.
+ * @param p_snapshot pointer to a pointer to a snapshot, set to NULL.
+ */
+void cow_snapshot_release (cow_snapshot **p_snapshot);
+
+#endif // COW_HASHMAP_H_
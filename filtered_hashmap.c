@@ -0,0 +1,216 @@
+#define _POSIX_C_SOURCE 200112L
+#include <stdlib.h>
+#include <string.h>
+#include "filtered_hashmap.h"
+#include "hashmap_ext.h"
+
+// Mixes the key's hash so the block and counter choice do not depend on the
+// low bits the hashmap indexes its buckets with (murmur3 finalizer).
+uint64_t filter_mix (uint64_t hash)
+{
+  hash ^= hash >> 33;
+  hash *= 0xFF51AFD7ED558CCDULL;
+  hash ^= hash >> 33;
+  hash *= 0xC4CEB9FE1A85EC53ULL;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+// Adds delta (1 or -1) to the counters of the key whose full hash (see
+// hashmap_hash) is key_hash, or with delta 0 checks them.
+// returns 1 if all the key's counters are set, 0 otherwise
+int filter_update (filtered_hashmap *map, size_t key_hash, int delta)
+{
+  uint64_t hash = filter_mix(key_hash);
+  unsigned char *block = map->blocks
+                         + (hash % map->block_count) * FILTER_BLOCK_BYTES;
+  hash /= map->block_count;
+  int present = 1;
+  int i = 0;
+  for (i = 0; i < FILTER_PROBES; i++)
+    {
+      size_t counter = (hash >> (7 * i)) & (FILTER_BLOCK_COUNTERS - 1);
+      unsigned char *byte = &block[counter / 2];
+      int shift = (int) (counter % 2) * 4;
+      int value = (*byte >> shift) & 0xF;
+      if (delta == 0)
+        {
+          present = present && value > 0;
+          continue;
+        }
+      if (value == FILTER_COUNTER_MAX || (delta < 0 && value == 0))
+        {
+          // saturated counters no longer know their count, leave them set
+          continue;
+        }
+      value += delta;
+      *byte = (unsigned char) ((*byte & ~(0xF << shift)) | (value << shift));
+    }
+  return present;
+}
+
+// Sizes the filter for the hashmap's current capacity and adds every key.
+// returns 0 if failed, 1 if succeeded
+int filter_rebuild (filtered_hashmap *map)
+{
+  size_t block_count = map->map->capacity * FILTER_COUNTERS_PER_BUCKET
+                       / FILTER_BLOCK_COUNTERS;
+  if (block_count == 0)
+    {
+      block_count = 1;
+    }
+  // every block on a cache line of its own
+  void *blocks = NULL;
+  if (posix_memalign(&blocks, FILTER_BLOCK_BYTES,
+                     FILTER_BLOCK_BYTES * block_count) != 0)
+    {
+      return 0;
+    }
+  memset(blocks, 0, FILTER_BLOCK_BYTES * block_count);
+  free(map->blocks);
+  map->blocks = blocks;
+  map->block_count = block_count;
+  map->sized_for = map->map->capacity;
+  map->stats.rebuilds++;
+  size_t i = 0;
+  size_t j = 0;
+  for (i = 0; i < map->map->capacity; i++)
+    {
+      vector *bucket = map->map->buckets[i];
+      for (j = 0; bucket != NULL && j < bucket->size; j++)
+        {
+          pair *stored = bucket->data[j];
+          filter_update(map, hashmap_hash(map->map, stored->key), 1);
+        }
+    }
+  return 1;
+}
+
+/**
+ * Allocates dynamically new filtered hash map.
+ * @param func a function which "hashes" keys.
+ * @return pointer to dynamically allocated filtered hashmap.
+ * @if_fail return NULL.
+ */
+filtered_hashmap *filtered_hashmap_alloc (hash_func func)
+{
+  filtered_hashmap *map = calloc(sizeof(*map), 1);
+  if (map == NULL)
+    {
+      return NULL;
+    }
+  map->map = hashmap_alloc(func);
+  if (map->map == NULL || filter_rebuild(map) == 0)
+    {
+      filtered_hashmap_free(&map);
+      return NULL;
+    }
+  map->stats.rebuilds = 0;
+  return map;
+}
+
+/**
+ * Frees a filtered hash map and the pairs it holds.
+ * @param p_map pointer to dynamically allocated pointer to filtered_hashmap.
+ */
+void filtered_hashmap_free (filtered_hashmap **p_map)
+{
+  if (p_map == NULL || *p_map == NULL)
+    {
+      return;
+    }
+  if ((*p_map)->map != NULL)
+    {
+      hashmap_free(&(*p_map)->map);
+    }
+  free((*p_map)->blocks);
+  free(*p_map);
+  *p_map = NULL;
+}
+
+/**
+ * Inserts a copy of in_pair (see hashmap_insert).
+ * @return returns 1 for successful insertion, 0 otherwise.
+ */
+int filtered_hashmap_insert (filtered_hashmap *map, const pair *in_pair)
+{
+  if (map == NULL || hashmap_insert(map->map, in_pair) == 0)
+    {
+      return 0;
+    }
+  // A failed rebuild keeps the old, denser filter: still no false negatives.
+  if (map->map->capacity != map->sized_for && filter_rebuild(map) == 1)
+    {
+      return 1;
+    }
+  filter_update(map, hashmap_hash(map->map, in_pair->key), 1);
+  return 1;
+}
+
+/**
+ * The function returns the value associated with the given key, asking the
+ * filter first.
+ * @return the value associated with key if exists, NULL otherwise.
+ */
+valueT filtered_hashmap_at (filtered_hashmap *map, const_keyT key)
+{
+  if (map == NULL || key == NULL)
+    {
+      return NULL;
+    }
+  map->stats.lookups++;
+  // the key is hashed once, for the filter and the map
+  size_t hash = hashmap_hash(map->map, key);
+  if (filter_update(map, hash, 0) == 0)
+    {
+      map->stats.filtered++;
+      return NULL;
+    }
+  pair *found = hashmap_find_hashed(map->map, key, hash);
+  if (found == NULL)
+    {
+      map->stats.false_positives++;
+      return NULL;
+    }
+  return found->value;
+}
+
+/**
+ * The function erases the pair associated with key.
+ * @return 1 if the erasing was done successfully, 0 otherwise.
+ */
+int filtered_hashmap_erase (filtered_hashmap *map, const_keyT key)
+{
+  if (map == NULL || key == NULL)
+    {
+      return 0;
+    }
+  size_t hash = hashmap_hash(map->map, key);
+  if (hashmap_find_hashed(map->map, key, hash) == NULL)
+    {
+      return 0;
+    }
+  // erasing never shrinks the map, the filter keeps its size
+  filter_update(map, hash, -1);
+  hashmap_erase(map->map, key);
+  return 1;
+}
+
+/**
+ * Returns the share of lookups for absent keys the filter let through.
+ * @param map a filtered hash map.
+ * @return the rate in [0, 1], 0 before any miss, -1 if map is NULL.
+ */
+double filtered_hashmap_false_positive_rate (const filtered_hashmap *map)
+{
+  if (map == NULL)
+    {
+      return -1;
+    }
+  double misses = map->stats.filtered + map->stats.false_positives;
+  if (misses == 0)
+    {
+      return 0;
+    }
+  return map->stats.false_positives / misses;
+}
@@ -0,0 +1,81 @@
+#ifndef FILTERED_HASHMAP_H_
+#define FILTERED_HASHMAP_H_
+
+#include <stdint.h>
+#include "hashmap.h"
+
+#define FILTER_BLOCK_BYTES 64UL
+#define FILTER_BLOCK_COUNTERS (FILTER_BLOCK_BYTES * 2)
+#define FILTER_COUNTERS_PER_BUCKET 8UL
+#define FILTER_PROBES 4
+#define FILTER_COUNTER_MAX 15
+
+/**
+ * Lookup statistics of a filtered hash map.
+ */
+typedef struct filter_stats {
+    size_t lookups;
+    size_t filtered;
+    size_t false_positives;
+    size_t rebuilds;
+} filter_stats;
+
+/**
+ * A hashmap with a blocked counting Bloom filter in front of it.
+ * Every key sets FILTER_PROBES 4-bit counters inside a single 64 byte
+ * block, aligned to 64 bytes, so a definite miss costs one cache line and
+ * no bucket walk.
+ * Counters go down on erase (a saturated counter stays put), and the filter
+ * is rebuilt at FILTER_COUNTERS_PER_BUCKET counters per bucket whenever the
+ * hashmap's capacity changes.
+ */
+typedef struct filtered_hashmap {
+    hashmap *map;
+    unsigned char *blocks;
+    size_t block_count;
+    size_t sized_for;
+    filter_stats stats;
+} filtered_hashmap;
+
+/**
+ * Allocates dynamically new filtered hash map.
+ * @param func a function which "hashes" keys.
+ * @return pointer to dynamically allocated filtered hashmap.
+ * @if_fail return NULL.
+ */
+filtered_hashmap *filtered_hashmap_alloc (hash_func func);
+
+/**
+ * Frees a filtered hash map and the pairs it holds.
+ * @param p_map pointer to dynamically allocated pointer to filtered_hashmap.
+ */
+void filtered_hashmap_free (filtered_hashmap **p_map);
+
+/**
+ * Inserts a copy of in_pair (see hashmap_insert).
+ * @return returns 1 for successful insertion, 0 otherwise.
+ */
+int filtered_hashmap_insert (filtered_hashmap *map, const pair *in_pair);
+
+/**
+ * The function returns the value associated with the given key, asking the
+ * filter first.
+ * @return the value associated with key if exists, NULL otherwise.
+ */
+valueT filtered_hashmap_at (filtered_hashmap *map, const_keyT key);
+
+/**
+ * The function erases the pair associated with key.
+ * @return 1 if the erasing was done successfully, 0 otherwise.
+ */
+int filtered_hashmap_erase (filtered_hashmap *map, const_keyT key);
+
+/**
+ * Returns the share of lookups for absent keys the filter let through to
+ * the hashmap (its observed false positive rate).
+ * @param map a filtered hash map.
+ * @return the rate in [0, 1], 0 before any miss, -1 if map is NULL.
+ */
+double filtered_hashmap_false_positive_rate (const filtered_hashmap *map);
+
+#endif // FILTERED_HASHMAP_H_
@@ -0,0 +1,356 @@
+#include <string.h>
+#include "frozen_hashmap.h"
+#include "slot_layout.h"
+
+// Derives independent hashes from a key's full hash (splitmix64 finalizer).
+uint64_t frozen_mix (uint64_t hash, uint64_t seed)
+{
+  uint64_t x = hash + (seed + 1) * 0x9E3779B97F4A7C15ULL;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+  return x ^ (x >> 31);
+}
+
+// Allocates a frozen map of the given shape with zeroed arrays.
+frozen_hashmap *frozen_alloc (hash_func func, size_t size, size_t key_size,
+                              size_t value_size)
+{
+  frozen_hashmap *map = calloc(sizeof(*map), 1);
+  if (map == NULL)
+    {
+      return NULL;
+    }
+  map->hash_func = func;
+  map->size = size;
+  map->groups = size / FROZEN_HASHMAP_LAMBDA + 1;
+  map->key_size = key_size;
+  map->value_size = value_size;
+  slot_layout(key_size, value_size, &map->value_offset, &map->stride);
+  map->displacements = calloc(sizeof(uint32_t), map->groups);
+  map->slots = calloc(map->stride, size + 1);
+  if (map->displacements == NULL || map->slots == NULL)
+    {
+      frozen_hashmap_free(&map);
+      return NULL;
+    }
+  return map;
+}
+
+// Tells whether two keys of a group share their full hash, then no
+// displacement can ever separate them.
+int frozen_group_collides (const uint64_t *hashes, const size_t *order,
+                           size_t start, size_t end)
+{
+  size_t k = 0;
+  size_t l = 0;
+  for (k = start; k < end; k++)
+    {
+      for (l = start; l < k; l++)
+        {
+          if (hashes[order[k]] == hashes[order[l]])
+            {
+              return 1;
+            }
+        }
+    }
+  return 0;
+}
+
+// Finds a displacement for every group, largest groups first, such that all
+// keys land in distinct slots. order lists the keys group by group, starts
+// holds each group's first position in order.
+// returns 0 if failed, 1 if succeeded
+int frozen_displace (frozen_hashmap *map, const uint64_t *hashes,
+                     const size_t *order, const size_t *starts,
+                     size_t *positions)
+{
+  size_t n = map->size;
+  size_t largest = 0;
+  size_t g = 0;
+  for (g = 0; g < map->groups; g++)
+    {
+      if (starts[g + 1] - starts[g] > largest)
+        {
+          largest = starts[g + 1] - starts[g];
+        }
+    }
+  char *taken = calloc(1, n + 1);
+  size_t *tried = calloc(sizeof(size_t), largest + 1);
+  if (taken == NULL || tried == NULL)
+    {
+      free(taken);
+      free(tried);
+      return 0;
+    }
+  size_t group_size = largest;
+  size_t free_slot = 0;
+  for (group_size = largest; group_size > 1; group_size--)
+    {
+      for (g = 0; g < map->groups; g++)
+        {
+          if (starts[g + 1] - starts[g] != group_size)
+            {
+              continue;
+            }
+          if (frozen_group_collides(hashes, order, starts[g], starts[g + 1]))
+            {
+              free(taken);
+              free(tried);
+              return 0;
+            }
+          uint32_t d = 0;
+          for (d = 0; d < FROZEN_HASHMAP_MAX_DISPLACEMENT; d++)
+            {
+              size_t k = 0;
+              for (k = 0; k < group_size; k++)
+                {
+                  size_t slot = frozen_mix(hashes[order[starts[g] + k]], d + 1)
+                                % n;
+                  size_t l = 0;
+                  for (l = 0; l < k && tried[l] != slot; l++)
+                    {
+                    }
+                  if (taken[slot] || l < k)
+                    {
+                      break;
+                    }
+                  tried[k] = slot;
+                }
+              if (k == group_size)
+                {
+                  break;
+                }
+            }
+          if (d == FROZEN_HASHMAP_MAX_DISPLACEMENT)
+            {
+              free(taken);
+              free(tried);
+              return 0;
+            }
+          map->displacements[g] = d;
+          size_t k = 0;
+          for (k = 0; k < group_size; k++)
+            {
+              taken[tried[k]] = 1;
+              positions[order[starts[g] + k]] = tried[k];
+            }
+        }
+    }
+  // Single key groups would need ever more tries as the slots fill up, they
+  // point straight at a free slot instead.
+  for (g = 0; g < map->groups; g++)
+    {
+      if (starts[g + 1] - starts[g] != 1)
+        {
+          continue;
+        }
+      while (taken[free_slot])
+        {
+          free_slot++;
+        }
+      taken[free_slot] = 1;
+      map->displacements[g] = FROZEN_HASHMAP_DIRECT | (uint32_t) free_slot;
+      positions[order[starts[g]]] = free_slot;
+    }
+  free(taken);
+  free(tried);
+  return 1;
+}
+
+/**
+ * Builds a frozen copy of a hashmap whose keys and values are key_size and
+ * value_size bytes long.
+ * @param hash_map a hash map, left untouched.
+ * @param key_size the size in bytes of every key.
+ * @param value_size the size in bytes of every value.
+ * @return pointer to dynamically allocated frozen hashmap.
+ * @if_fail return NULL.
+ */
+frozen_hashmap *hashmap_freeze (const hashmap *hash_map, size_t key_size,
+                                size_t value_size)
+{
+  if (hash_map == NULL || hash_map->hash_func == NULL || key_size == 0
+      || key_size > FROZEN_HASHMAP_MAX_ELEM_SIZE
+      || value_size > FROZEN_HASHMAP_MAX_ELEM_SIZE
+      || hash_map->size >= FROZEN_HASHMAP_DIRECT)
+    {
+      return NULL;
+    }
+  size_t n = hash_map->size;
+  frozen_hashmap *map = frozen_alloc(hash_map->hash_func, n, key_size,
+                                     value_size);
+  pair **pairs = calloc(sizeof(pair *), n + 1);
+  uint64_t *hashes = calloc(sizeof(uint64_t), n + 1);
+  size_t *order = calloc(sizeof(size_t), n + 1);
+  size_t *positions = calloc(sizeof(size_t), n + 1);
+  size_t *starts = NULL;
+  if (map != NULL)
+    {
+      starts = calloc(sizeof(size_t), map->groups + 1);
+    }
+  int check = map != NULL && pairs != NULL && hashes != NULL && order != NULL
+              && positions != NULL && starts != NULL;
+  size_t i = 0;
+  size_t j = 0;
+  size_t k = 0;
+  for (i = 0; check && i < hash_map->capacity; i++)
+    {
+      vector *bucket = hash_map->buckets[i];
+      for (j = 0; bucket != NULL && j < bucket->size; j++)
+        {
+          pairs[k] = (pair *) bucket->data[j];
+          hashes[k] = hash_map->hash_func(pairs[k]->key);
+          starts[frozen_mix(hashes[k], 0) % map->groups + 1]++;
+          k++;
+        }
+    }
+  if (check)
+    {
+      // counting sort of the keys by group
+      for (i = 0; i < map->groups; i++)
+        {
+          starts[i + 1] += starts[i];
+        }
+      for (k = 0; k < n; k++)
+        {
+          positions[k] = starts[frozen_mix(hashes[k], 0) % map->groups]++;
+          order[positions[k]] = k;
+        }
+      for (i = map->groups; i > 0; i--)
+        {
+          starts[i] = starts[i - 1];
+        }
+      starts[0] = 0;
+      check = n == 0 || frozen_displace(map, hashes, order, starts, positions);
+    }
+  for (k = 0; check && k < n; k++)
+    {
+      char *slot = map->slots + positions[k] * map->stride;
+      memcpy(slot, pairs[k]->key, key_size);
+      memcpy(slot + map->value_offset, pairs[k]->value, value_size);
+    }
+  free(pairs);
+  free(hashes);
+  free(order);
+  free(positions);
+  free(starts);
+  if (!check)
+    {
+      frozen_hashmap_free(&map);
+    }
+  return map;
+}
+
+/**
+ * Frees a frozen hash map.
+ * @param p_map pointer to dynamically allocated pointer to frozen_hashmap.
+ */
+void frozen_hashmap_free (frozen_hashmap **p_map)
+{
+  if (p_map == NULL || *p_map == NULL)
+    {
+      return;
+    }
+  free((*p_map)->displacements);
+  free((*p_map)->slots);
+  free(*p_map);
+  *p_map = NULL;
+}
+
+/**
+ * The function returns the value associated with the given key.
+ * @param map a frozen hash map.
+ * @param key the key to be checked.
+ * @return pointer to the value inside the map if exists, NULL otherwise.
+ */
+const_valueT frozen_hashmap_at (const frozen_hashmap *map, const_keyT key)
+{
+  if (map == NULL || key == NULL || map->size == 0)
+    {
+      return NULL;
+    }
+  uint64_t hash = map->hash_func(key);
+  uint32_t d = map->displacements[frozen_mix(hash, 0) % map->groups];
+  size_t ind = d & ~FROZEN_HASHMAP_DIRECT;
+  if ((d & FROZEN_HASHMAP_DIRECT) == 0)
+    {
+      ind = frozen_mix(hash, d + 1) % map->size;
+    }
+  const char *slot = map->slots + ind * map->stride;
+  if (memcmp(slot, key, map->key_size) != 0)
+    {
+      return NULL;
+    }
+  return slot + map->value_offset;
+}
+
+// Mixes the hashes of the first stored keys, to tell whether a map is read
+// with the hash func (and seed) it was frozen with.
+uint64_t frozen_fingerprint (const frozen_hashmap *map)
+{
+  uint64_t fingerprint = 0;
+  size_t i = 0;
+  for (i = 0; i < map->size && i < FROZEN_HASHMAP_FINGERPRINT_KEYS; i++)
+    {
+      fingerprint = frozen_mix(fingerprint
+                               ^ map->hash_func(map->slots + i * map->stride),
+                               i);
+    }
+  return fingerprint;
+}
+
+/**
+ * Writes a frozen hash map to a binary stream (native byte order). The
+ * header records a fingerprint of the hashes of the first stored keys.
+ * @return 1 if succeeded, 0 otherwise.
+ */
+int frozen_hashmap_save (const frozen_hashmap *map, FILE *out)
+{
+  if (map == NULL || out == NULL)
+    {
+      return 0;
+    }
+  uint64_t header[] = {FROZEN_HASHMAP_MAGIC, FROZEN_HASHMAP_VERSION,
+                       map->size, map->key_size, map->value_size,
+                       frozen_fingerprint(map)};
+  return fwrite(header, sizeof(header), 1, out) == 1
+         && fwrite(map->displacements, sizeof(uint32_t), map->groups, out)
+            == map->groups
+         && fwrite(map->slots, map->stride, map->size, out) == map->size;
+}
+
+/**
+ * Reads a frozen hash map written by frozen_hashmap_save. The header is
+ * checked before anything is allocated.
+ * @param in the stream.
+ * @param func the hash func the map was frozen with.
+ * @return pointer to dynamically allocated frozen hashmap.
+ * @if_fail return NULL (also when func hashes the keys otherwise than at
+ * saving time).
+ */
+frozen_hashmap *frozen_hashmap_load (FILE *in, hash_func func)
+{
+  uint64_t header[6];
+  if (in == NULL || func == NULL || fread(header, sizeof(header), 1, in) != 1
+      || header[0] != FROZEN_HASHMAP_MAGIC
+      || header[1] != FROZEN_HASHMAP_VERSION
+      || header[2] >= FROZEN_HASHMAP_DIRECT || header[3] == 0
+      || header[3] > FROZEN_HASHMAP_MAX_ELEM_SIZE
+      || header[4] > FROZEN_HASHMAP_MAX_ELEM_SIZE)
+    {
+      return NULL;
+    }
+  frozen_hashmap *map = frozen_alloc(func, header[2], header[3], header[4]);
+  if (map == NULL)
+    {
+      return NULL;
+    }
+  if (fread(map->displacements, sizeof(uint32_t), map->groups, in)
+      != map->groups
+      || fread(map->slots, map->stride, map->size, in) != map->size
+      || frozen_fingerprint(map) != header[5])
+    {
+      frozen_hashmap_free(&map);
+    }
+  return map;
+}
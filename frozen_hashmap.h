@@ -0,0 +1,86 @@
+#ifndef FROZEN_HASHMAP_H_
+#define FROZEN_HASHMAP_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include "hashmap.h"
+
+#define FROZEN_HASHMAP_LAMBDA 4UL
+#define FROZEN_HASHMAP_MAX_DISPLACEMENT (1UL << 20)
+#define FROZEN_HASHMAP_DIRECT 0x80000000UL
+#define FROZEN_HASHMAP_MAGIC 0x5A464D48UL
+#define FROZEN_HASHMAP_VERSION 2UL
+#define FROZEN_HASHMAP_MAX_ELEM_SIZE (1UL << 16)
+#define FROZEN_HASHMAP_FINGERPRINT_KEYS 8UL
+
+/**
+ * A read-only snapshot of a hashmap with fixed size keys and values.
+ * The keys are placed by a minimal perfect hash (CHD, hash and displace):
+ * every key hashes to one of size / FROZEN_HASHMAP_LAMBDA groups, and the
+ * group's displacement picks the slot, so the n pairs fill exactly n slots
+ * of one dense array and a lookup is one slot read plus one key compare.
+ * Groups of a single key store their slot directly (FROZEN_HASHMAP_DIRECT
+ * set). The displacements cost about one byte per pair.
+ */
+typedef struct frozen_hashmap {
+    uint32_t *displacements;
+    char *slots;
+    size_t size;
+    size_t groups;
+    size_t key_size;
+    size_t value_offset;
+    size_t value_size;
+    size_t stride;
+    hash_func hash_func;
+} frozen_hashmap;
+
+/**
+ * Builds a frozen copy of a hashmap whose keys and values are key_size and
+ * value_size bytes long (copied bytewise, keys are compared bytewise).
+ * @param hash_map a hash map, left untouched.
+ * @param key_size the size in bytes of every key.
+ * @param value_size the size in bytes of every value.
+ * @return pointer to dynamically allocated frozen hashmap.
+ * @if_fail return NULL (also when two keys share the same full hash, which
+ * no perfect hash can separate, for FROZEN_HASHMAP_DIRECT pairs or more,
+ * for keys or values over FROZEN_HASHMAP_MAX_ELEM_SIZE bytes, or for a map
+ * of hashmap_alloc_seeded, whose hash_func is NULL).
+ */
+frozen_hashmap *hashmap_freeze (const hashmap *hash_map, size_t key_size,
+                                size_t value_size);
+
+/**
+ * Frees a frozen hash map.
+ * @param p_map pointer to dynamically allocated pointer to frozen_hashmap.
+ */
+void frozen_hashmap_free (frozen_hashmap **p_map);
+
+/**
+ * The function returns the value associated with the given key.
+ * @param map a frozen hash map.
+ * @param key the key to be checked.
+ * @return pointer to the value inside the map if exists, NULL otherwise.
+ */
+const_valueT frozen_hashmap_at (const frozen_hashmap *map, const_keyT key);
+
+/**
+ * Writes a frozen hash map to a binary stream (native byte order). The
+ * header records a fingerprint of the hashes of the first
+ * FROZEN_HASHMAP_FINGERPRINT_KEYS stored keys.
+ * @return 1 if succeeded, 0 otherwise.
+ */
+int frozen_hashmap_save (const frozen_hashmap *map, FILE *out);
+
+/**
+ * Reads a frozen hash map written by frozen_hashmap_save. Nothing is
+ * rebuilt, the arrays are read as they are. The header is checked before
+ * anything is allocated.
+ * @param in the stream.
+ * @param func the hash func the map was frozen with.
+ * @return pointer to dynamically allocated frozen hashmap.
+ * @if_fail return NULL (also when func, or its seed, hashes the stored keys
+ * otherwise than at saving time).
+ */
+frozen_hashmap *frozen_hashmap_load (FILE *in, hash_func func);
+
+#endif // FROZEN_HASHMAP_H_
@@ -2,6 +2,8 @@
 #define HASHFUNCS_H_
 
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 
 /**
  * Integers simple hash func.
@@ -27,4 +29,95 @@ size_t hash_double(const void *elem){
     return hash;
 }
 
+#define SIPHASH_ROTL(x, b) (((x) << (b)) | ((x) >> (64 - (b))))
+#define SIPHASH_ROUND(v0, v1, v2, v3) \
+  do { \
+    v0 += v1; v1 = SIPHASH_ROTL(v1, 13); v1 ^= v0; v0 = SIPHASH_ROTL(v0, 32); \
+    v2 += v3; v3 = SIPHASH_ROTL(v3, 16); v3 ^= v2; \
+    v0 += v3; v3 = SIPHASH_ROTL(v3, 21); v3 ^= v0; \
+    v2 += v1; v1 = SIPHASH_ROTL(v1, 17); v1 ^= v2; v2 = SIPHASH_ROTL(v2, 32); \
+  } while (0)
+
+/**
+ * SipHash-1-3 keyed hash of len bytes of data.
+ * Without the 128 bit key an attacker cannot pick keys that collide, which
+ * is what keeps bucket chains short for keys coming from the outside.
+ */
+static inline uint64_t siphash13 (const void *data, size_t len,
+                                  const uint64_t key[2])
+{
+  const unsigned char *in = (const unsigned char *) data;
+  uint64_t v0 = 0x736f6d6570736575ULL ^ key[0];
+  uint64_t v1 = 0x646f72616e646f6dULL ^ key[1];
+  uint64_t v2 = 0x6c7967656e657261ULL ^ key[0];
+  uint64_t v3 = 0x7465646279746573ULL ^ key[1];
+  uint64_t m = 0;
+  size_t i = 0;
+  for (i = 0; i + 8 <= len; i += 8)
+    {
+      int k = 0;
+      m = 0;
+      for (k = 0; k < 8; k++)
+        {
+          m |= ((uint64_t) in[i + k]) << (8 * k);
+        }
+      v3 ^= m;
+      SIPHASH_ROUND(v0, v1, v2, v3);
+      v0 ^= m;
+    }
+  m = ((uint64_t) len) << 56;
+  size_t k = 0;
+  for (k = 0; i + k < len; k++)
+    {
+      m |= ((uint64_t) in[i + k]) << (8 * k);
+    }
+  v3 ^= m;
+  SIPHASH_ROUND(v0, v1, v2, v3);
+  v0 ^= m;
+  v2 ^= 0xff;
+  SIPHASH_ROUND(v0, v1, v2, v3);
+  SIPHASH_ROUND(v0, v1, v2, v3);
+  SIPHASH_ROUND(v0, v1, v2, v3);
+  return v0 ^ v1 ^ v2 ^ v3;
+}
+
+/**
+ * Integers seeded hash func, see hashmap_alloc_seeded.
+ */
+static inline size_t hash_int_seeded (const void *elem, const uint64_t *seed)
+{
+  return (size_t) siphash13(elem, sizeof(int), seed);
+}
+
+/**
+ * Chars seeded hash func, see hashmap_alloc_seeded.
+ */
+static inline size_t hash_char_seeded (const void *elem, const uint64_t *seed)
+{
+  return (size_t) siphash13(elem, sizeof(char), seed);
+}
+
+/**
+ * Doubles seeded hash func, see hashmap_alloc_seeded.
+ */
+static inline size_t hash_double_seeded (const void *elem,
+                                         const uint64_t *seed)
+{
+  double value = *((double *) elem);
+  if (value == 0)
+    {
+      value = 0; // -0.0 and 0.0 must hash alike
+    }
+  return (size_t) siphash13(&value, sizeof(double), seed);
+}
+
+/**
+ * C strings seeded hash func, see hashmap_alloc_seeded.
+ */
+static inline size_t hash_string_seeded (const void *elem,
+                                         const uint64_t *seed)
+{
+  return (size_t) siphash13(elem, strlen((const char *) elem), seed);
+}
+
 #endif // HASHFUNCS_H_
\ No newline at end of file
@@ -0,0 +1,27 @@
+#include <stdio.h>
+#include <time.h>
+#include "hash_seed.h"
+
+// Counts the fallback keys, so two drawn in the same clock tick differ.
+static uint64_t fallback_count;
+
+/**
+ * Fills a fresh random key for the seeded hash funcs.
+ */
+void hash_seed_random (uint64_t seed[2])
+{
+  FILE *random = fopen("/dev/urandom", "rb");
+  if (random == NULL || fread(seed, sizeof(uint64_t), 2, random) != 2)
+    {
+      uint64_t count = __atomic_add_fetch(&fallback_count, 1,
+                                          __ATOMIC_RELAXED);
+      seed[0] = ((uint64_t) time(NULL)) ^ (uint64_t) (uintptr_t) seed
+                ^ (count * 0x9E3779B97F4A7C15ULL);
+      seed[1] = ((uint64_t) clock()) ^ (uint64_t) (uintptr_t) random
+                ^ (count << 32);
+    }
+  if (random != NULL)
+    {
+      fclose(random);
+    }
+}
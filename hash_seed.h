@@ -0,0 +1,15 @@
+#ifndef HASH_SEED_H_
+#define HASH_SEED_H_
+
+#include <stdint.h>
+
+/**
+ * Fills a fresh random 128 bit key for the seeded hash funcs, as
+ * hashmap_alloc_seeded draws one for each map. It is read from
+ * /dev/urandom (falls back to time, address and counter entropy), so no
+ * two maps, and no two runs, share a key.
+ * @param seed the two words of the key.
+ */
+void hash_seed_random (uint64_t seed[2]);
+
+#endif // HASH_SEED_H_
@@ -1,330 +1,1958 @@
+#include <string.h>
+#include <pthread.h>
 #include "hashmap.h"
+#include "hashmap_ext.h"
+#include "hashmap_bucket.h"
+#include "bucket_alloc.h"
+#include "hashmap_account.h"
+#include "hash_seed.h"
+
+// Chains longer than this are kept sorted by the full hash of their keys, so
+// even a bucket flooded with colliding indices is searched in O(log n). Keys
+// of one full hash are still compared one by one, as keys have no order:
+// a hash func that maps many keys to one hash (hash_double truncates) scans
+// them linearly, the seeded ones of hash_funcs.h collide only by chance.
+#define HASH_MAP_SORTED_CHAIN_LEN 8
+
+// Blocks of a slot_pool are powers of two from SLOT_POOL_MIN_BLOCK bytes,
+// carved from chunks of SLOT_POOL_CHUNK bytes. Larger blocks are mapped on
+// their own.
+#define SLOT_POOL_CHUNK BUCKET_ALLOC_MMAP_THRESHOLD
+#define SLOT_POOL_MIN_BLOCK 64UL
+#define SLOT_POOL_MAX_BLOCK (SLOT_POOL_CHUNK / 4)
+#define SLOT_POOL_CLASSES 14
+
+// The bucket vectors and slot arrays of a map with a non-default bucket
+// policy. They hold most of a large map's memory, and malloc would place
+// them on 4K pages of whatever node touched them first, so they are carved
+// from chunks mapped under the policy instead. Freed blocks go to a free
+// list per size, the chunks are unmapped with the map. The lock lets
+// rehash workers free blocks concurrently.
+typedef struct slot_pool {
+    pthread_mutex_t lock;
+    unsigned char *chunks;
+    size_t used;
+    void *free_blocks[SLOT_POOL_CLASSES];
+} slot_pool;
+
+// The settings of one hashmap. hashmap_alloc allocates them around the
+// public struct, which comes first, so a hashmap pointer leads to them.
+// bytes counts the memory of the map as its account does (see
+// hashmap_account), the account holds the sum over its maps.
+typedef struct hashmap_state {
+    hashmap map;
+    bucket_policy policy;
+    size_t rehash_threads;
+    hashmap_account *account;
+    size_t bytes;
+    slot_pool *pool;
+    seeded_hash_func seeded;
+    uint64_t seed[2];
+} hashmap_state;
+
+// A pair held by a hashmap. hashmap.c allocates it with the full hash of
+// its key, computed once on insert, so sorting, searching and rehashing
+// chains never hash again. The pair comes first: it is used and freed
+// (pair_free) as a plain pair. bytes is what the pair is charged to the
+// map, released exactly when it goes, whatever its key and value have
+// become in place since.
+typedef struct hashed_pair {
+    pair pair;
+    size_t hash;
+    size_t bytes;
+} hashed_pair;
+
+// Returns the settings of a hashmap allocated by hashmap_alloc.
+hashmap_state *state_of (const hashmap *hash_map)
+{
+  return (hashmap_state *) hash_map;
+}
+
+// Charges bytes to a hashmap and to its account.
+// returns 0 if they would exceed the account's budget, 1 otherwise
+int map_charge (const hashmap *hash_map, size_t bytes)
+{
+  hashmap_state *state = state_of(hash_map);
+  if (account_charge(state->account, bytes) == 0)
+    {
+      return 0;
+    }
+  state->bytes += bytes;
+  return 1;
+}
+
+// Credits bytes back to a hashmap and to its account.
+void map_release (const hashmap *hash_map, size_t bytes)
+{
+  hashmap_state *state = state_of(hash_map);
+  account_release(state->account, bytes);
+  state->bytes -= bytes;
+}
+
+// Returns the bytes a pair held by a hashmap is charged.
+size_t map_pair_bytes (const hashmap *hash_map, const pair *in_pair)
+{
+  return account_pair_bytes(state_of(hash_map)->account, in_pair);
+}
+
+// Returns the bytes a pair stored in a hashmap was charged.
+size_t charged_bytes (const void *stored)
+{
+  return ((const hashed_pair *) stored)->bytes;
+}
+
+// Charges or releases the difference after a pair stored in a hashmap
+// changed in place. If the growth does not fit in the account's budget,
+// the pair keeps its old charge.
+void pair_recharge (const hashmap *hash_map, void *stored)
+{
+  hashed_pair *a = stored;
+  size_t bytes = map_pair_bytes(hash_map, &a->pair);
+  if (bytes < a->bytes)
+    {
+      map_release(hash_map, a->bytes - bytes);
+      a->bytes = bytes;
+    }
+  else if (bytes > a->bytes && map_charge(hash_map, bytes - a->bytes) == 1)
+    {
+      a->bytes = bytes;
+    }
+}
+
+// Returns the size class of a block of bytes in a slot_pool.
+size_t pool_class (size_t bytes)
+{
+  size_t c = 0;
+  while ((SLOT_POOL_MIN_BLOCK << c) < bytes)
+    {
+      c++;
+    }
+  return c;
+}
+
+// Returns the mapped length of a block too large for the chunks of a pool.
+size_t pool_block_len (size_t bytes)
+{
+  return (bytes + SLOT_POOL_CHUNK - 1) & ~(SLOT_POOL_CHUNK - 1);
+}
+
+// Carves a block of size bytes from the newest chunk of a hashmap's pool,
+// mapping a new chunk under the map's policy, charged to it, when the
+// newest one is full. The pool's lock is held.
+void *pool_carve (const hashmap *hash_map, slot_pool *pool, size_t size)
+{
+  if (pool->chunks == NULL || pool->used + size > SLOT_POOL_CHUNK)
+    {
+      if (map_charge(hash_map, SLOT_POOL_CHUNK) == 0)
+        {
+          return NULL;
+        }
+      unsigned char *chunk = bucket_alloc_policy(SLOT_POOL_CHUNK, 1,
+                                                 &state_of(hash_map)->policy);
+      if (chunk == NULL)
+        {
+          map_release(hash_map, SLOT_POOL_CHUNK);
+          return NULL;
+        }
+      // the chunks are linked through their first block
+      *(unsigned char **) chunk = pool->chunks;
+      pool->chunks = chunk;
+      pool->used = SLOT_POOL_MIN_BLOCK;
+    }
+  void *block = pool->chunks + pool->used;
+  pool->used += size;
+  return block;
+}
+
+// Allocates a zeroed block of bytes for a bucket of a hashmap, from its
+// pool if it has one. The bytes this takes from the system are charged to
+// the map, or only added to *tally if given (rehash workers, which never
+// allocate from a pool).
+// returns the block, NULL if failed
+void *block_alloc (const hashmap *hash_map, size_t bytes, size_t *tally)
+{
+  hashmap_state *state = state_of(hash_map);
+  slot_pool *pool = state->pool;
+  void *block = NULL;
+  if (pool == NULL || bytes > SLOT_POOL_MAX_BLOCK)
+    {
+      size_t len = pool == NULL ? bytes : pool_block_len(bytes);
+      if (tally == NULL && map_charge(hash_map, len) == 0)
+        {
+          return NULL;
+        }
+      block = pool == NULL ? calloc(bytes, 1)
+                           : bucket_alloc_policy(len, 1, &state->policy);
+      if (block == NULL && tally == NULL)
+        {
+          map_release(hash_map, len);
+        }
+      if (block != NULL && tally != NULL)
+        {
+          *tally += len;
+        }
+      return block;
+    }
+  size_t c = pool_class(bytes);
+  pthread_mutex_lock(&pool->lock);
+  block = pool->free_blocks[c];
+  if (block != NULL)
+    {
+      pool->free_blocks[c] = *(void **) block;
+    }
+  else
+    {
+      block = pool_carve(hash_map, pool, SLOT_POOL_MIN_BLOCK << c);
+    }
+  pthread_mutex_unlock(&pool->lock);
+  if (block != NULL)
+    {
+      memset(block, 0, bytes);
+    }
+  return block;
+}
+
+// Frees a block of bytes allocated by block_alloc. The bytes this gives
+// back to the system are released from the map, or only added to *tally
+// if given.
+void block_free (const hashmap *hash_map, void *block, size_t bytes,
+                 size_t *tally)
+{
+  if (block == NULL)
+    {
+      return;
+    }
+  slot_pool *pool = state_of(hash_map)->pool;
+  size_t released = 0;
+  if (pool == NULL)
+    {
+      free(block);
+      released = bytes;
+    }
+  else if (bytes > SLOT_POOL_MAX_BLOCK)
+    {
+      released = pool_block_len(bytes);
+      bucket_free(block, released, 1);
+    }
+  else
+    {
+      size_t c = pool_class(bytes);
+      pthread_mutex_lock(&pool->lock);
+      *(void **) block = pool->free_blocks[c];
+      pool->free_blocks[c] = block;
+      pthread_mutex_unlock(&pool->lock);
+    }
+  if (tally != NULL)
+    {
+      *tally += released;
+    }
+  else
+    {
+      map_release(hash_map, released);
+    }
+}
+
+// Resizes a block allocated by block_alloc from old_bytes to new_bytes,
+// like realloc, charging or releasing the difference.
+// returns the block, NULL if failed (the block is then left intact)
+void *block_resize (const hashmap *hash_map, void *block, size_t old_bytes,
+                    size_t new_bytes)
+{
+  if (state_of(hash_map)->pool == NULL)
+    {
+      if (new_bytes > old_bytes
+          && map_charge(hash_map, new_bytes - old_bytes) == 0)
+        {
+          return NULL;
+        }
+      void *resized = realloc(block, new_bytes);
+      if (resized == NULL && new_bytes > old_bytes)
+        {
+          map_release(hash_map, new_bytes - old_bytes);
+        }
+      if (resized != NULL && new_bytes < old_bytes)
+        {
+          map_release(hash_map, old_bytes - new_bytes);
+        }
+      return resized;
+    }
+  void *resized = block_alloc(hash_map, new_bytes, NULL);
+  if (resized == NULL)
+    {
+      return NULL;
+    }
+  memcpy(resized, block, old_bytes < new_bytes ? old_bytes : new_bytes);
+  block_free(hash_map, block, old_bytes, NULL);
+  return resized;
+}
+
+// Allocates an empty bucket vector of cap slots for a hashmap (see
+// block_alloc), NULL if failed. Bucket vectors are built here rather than
+// by vector_alloc, so that both of their blocks come from the map's pool.
+vector *bucket_vector_alloc (const hashmap *hash_map, size_t cap,
+                             size_t *tally)
+{
+  vector *bucket = block_alloc(hash_map, sizeof(vector), tally);
+  if (bucket == NULL)
+    {
+      return NULL;
+    }
+  bucket->data = block_alloc(hash_map, cap * sizeof(void *), tally);
+  if (bucket->data == NULL)
+    {
+      block_free(hash_map, bucket, sizeof(vector), tally);
+      return NULL;
+    }
+  bucket->capacity = cap;
+  bucket->size = 0;
+  bucket->elem_copy_func = pair_copy;
+  bucket->elem_cmp_func = pair_cmp;
+  bucket->elem_free_func = pair_free;
+  return bucket;
+}
+
+// Frees a bucket vector of a hashmap (see block_free), but not the pairs it
+// still holds.
+void bucket_vector_free (const hashmap *hash_map, vector **p_bucket,
+                         size_t *tally)
+{
+  if (*p_bucket == NULL)
+    {
+      return;
+    }
+  block_free(hash_map, (*p_bucket)->data,
+             (*p_bucket)->capacity * sizeof(void *), tally);
+  block_free(hash_map, *p_bucket, sizeof(vector), tally);
+  *p_bucket = NULL;
+}
+
+// Unmaps the chunks of a hashmap's pool and frees it. Its blocks must have
+// been freed.
+void pool_destroy (hashmap *hash_map)
+{
+  hashmap_state *state = state_of(hash_map);
+  slot_pool *pool = state->pool;
+  while (pool->chunks != NULL)
+    {
+      unsigned char *chunk = pool->chunks;
+      pool->chunks = *(unsigned char **) chunk;
+      bucket_free(chunk, SLOT_POOL_CHUNK, 1);
+      map_release(hash_map, SLOT_POOL_CHUNK);
+    }
+  pthread_mutex_destroy(&pool->lock);
+  free(pool);
+  map_release(hash_map, sizeof(slot_pool));
+  state->pool = NULL;
+}
+
+// Gives a hashmap a pool and moves its bucket vectors into it.
+// returns 0 if failed (the map is left as it was), 1 if succeeded
+int pool_adopt (hashmap *hash_map)
+{
+  hashmap_state *state = state_of(hash_map);
+  if (map_charge(hash_map, sizeof(slot_pool)) == 0)
+    {
+      return 0;
+    }
+  slot_pool *pool = calloc(sizeof(*pool), 1);
+  vector **moved = calloc(sizeof(vector *), hash_map->capacity);
+  if (pool == NULL || moved == NULL
+      || pthread_mutex_init(&pool->lock, NULL) != 0)
+    {
+      free(pool);
+      free(moved);
+      map_release(hash_map, sizeof(slot_pool));
+      return 0;
+    }
+  state->pool = pool;
+  int check = 1;
+  size_t i = 0;
+  for (i = 0; check && i < hash_map->capacity; i++)
+    {
+      vector *bucket = hash_map->buckets[i];
+      if (bucket == NULL)
+        {
+          continue;
+        }
+      moved[i] = bucket_vector_alloc(hash_map, bucket->capacity, NULL);
+      check = moved[i] != NULL;
+      if (check)
+        {
+          memcpy(moved[i]->data, bucket->data,
+                 bucket->size * sizeof(void *));
+          moved[i]->size = bucket->size;
+        }
+    }
+  if (!check)
+    {
+      for (i = 0; i < hash_map->capacity; i++)
+        {
+          bucket_vector_free(hash_map, &moved[i], NULL);
+        }
+      pool_destroy(hash_map);
+      free(moved);
+      return 0;
+    }
+  // the old vectors came from malloc
+  state->pool = NULL;
+  for (i = 0; i < hash_map->capacity; i++)
+    {
+      bucket_vector_free(hash_map, &hash_map->buckets[i], NULL);
+      hash_map->buckets[i] = moved[i];
+    }
+  state->pool = pool;
+  free(moved);
+  return 1;
+}
+
+// Allocates a bucket array of a hashmap, under its policy, charged to it.
+vector **table_alloc (const hashmap *hash_map, size_t count)
+{
+  if (map_charge(hash_map, count * sizeof(void *)) == 0)
+    {
+      return NULL;
+    }
+  vector **buckets = bucket_alloc_policy(count, sizeof(void *),
+                                         &state_of(hash_map)->policy);
+  if (buckets == NULL)
+    {
+      map_release(hash_map, count * sizeof(void *));
+    }
+  return buckets;
+}
+
+// Frees a bucket array of a hashmap allocated by table_alloc.
+void table_free (const hashmap *hash_map, vector **buckets, size_t count)
+{
+  if (buckets != NULL)
+    {
+      map_release(hash_map, count * sizeof(void *));
+    }
+  bucket_free(buckets, count, sizeof(void *));
+}
+
+// Allocates a hashmap hashing its keys by func, or by seeded under a fresh
+// random seed.
+hashmap *map_alloc (hash_func func, seeded_hash_func seeded)
+{
+  hashmap_state *state = calloc(sizeof(*state), 1);
+  if (state == NULL)
+    {
+      return NULL;
+    }
+  // not charged to any account yet, see hashmap_set_account
+  state->account = NULL;
+  state->bytes = sizeof(*state);
+  hashmap *table = &state->map;
+  state->policy.flags = BUCKET_ALLOC_DEFAULT;
+  state->policy.node = 0;
+  state->rehash_threads = 1;
+  table->size = 0;
+  table->capacity = HASH_MAP_INITIAL_CAP;
+  table->hash_func = func;
+  state->seeded = seeded;
+  if (seeded != NULL)
+    {
+      hash_seed_random(state->seed);
+    }
+  table->buckets = table_alloc(table, table->capacity);
+  if (table->buckets == NULL)
+    {
+      free(state);
+      return NULL;
+    }
+  return table;
+}
+
 /**
  * Allocates dynamically new hash map element.
  * @param func a function which "hashes" keys.
  * @return pointer to dynamically allocated hashmap.
  * @if_fail return NULL.
  */
-hashmap *hashmap_alloc (hash_func func)
+hashmap *hashmap_alloc (hash_func func)
+{
+  if (func == NULL)
+    {
+      return NULL;
+    }
+  return map_alloc(func, NULL);
+}
+
+/**
+ * Allocates a hash map whose keys are hashed by func under a random key of
+ * its own. Its hash_func field is NULL, hashmap_hash hashes its keys.
+ * @param func a seeded hash func.
+ * @return pointer to dynamically allocated hashmap.
+ * @if_fail return NULL.
+ */
+hashmap *hashmap_alloc_seeded (seeded_hash_func func)
+{
+  if (func == NULL)
+    {
+      return NULL;
+    }
+  return map_alloc(NULL, func);
+}
+
+/**
+ * Replaces the seed of an empty map allocated by hashmap_alloc_seeded.
+ * @param hash_map a hash map.
+ * @param k0 the first word of the key.
+ * @param k1 the second word of the key.
+ * @return 1 if succeeded, 0 otherwise (also if the map is not seeded or
+ * not empty).
+ */
+int hashmap_set_seed (hashmap *hash_map, uint64_t k0, uint64_t k1)
+{
+  if (hash_map == NULL || state_of(hash_map)->seeded == NULL
+      || hash_map->size != 0)
+    {
+      return 0;
+    }
+  state_of(hash_map)->seed[0] = k0;
+  state_of(hash_map)->seed[1] = k1;
+  return 1;
+}
+
+/**
+ * Returns the full hash of a key in a hash map, by its hash_func or under
+ * its seed.
+ * @param hash_map a hash map.
+ * @param key the key to hash.
+ * @return the hash.
+ */
+size_t hashmap_hash (const hashmap *hash_map, const_keyT key)
+{
+  const hashmap_state *state = state_of(hash_map);
+  if (state->seeded != NULL)
+    {
+      return state->seeded(key, state->seed);
+    }
+  return hash_map->hash_func(key);
+}
+
+/**
+ * Frees a hash map and the elements the hash map itself allocated.
+ * @param p_hash_map pointer to dynamically allocated pointer to hash_map.
+ */
+void hashmap_free (hashmap **p_hash_map)
+{
+  hashmap *hash_map = *p_hash_map;
+  size_t i = 0;
+  size_t j = 0;
+  while (i < hash_map->capacity)
+    {
+      vector *bucket = hash_map->buckets[i];
+      for (j = 0; bucket != NULL && j < bucket->size; j++)
+        {
+          pair_free(&bucket->data[j]);
+        }
+      bucket_vector_free(hash_map, &hash_map->buckets[i], NULL);
+      i++;
+    }
+  table_free(hash_map, hash_map->buckets, hash_map->capacity);
+  hashmap_state *state = state_of(hash_map);
+  if (state->pool != NULL)
+    {
+      pool_destroy(hash_map);
+    }
+  // whatever else the map held is credited back at once
+  account_release(state->account, state->bytes);
+  free(state);
+  *p_hash_map = NULL;
+}
+
+/**
+ * Sets the bucket_alloc policy of a hash map: of its bucket arrays, and of
+ * the vectors and slot arrays of its buckets. The first policy other than
+ * BUCKET_ALLOC_DEFAULT moves the buckets into a pool of chunks mapped
+ * under it; memory allocated later follows the policy set last. With
+ * BUCKET_ALLOC_NUMA_BIND the current array and chunks are also migrated to
+ * the node if they are mmap backed.
+ * @param hash_map a hash map.
+ * @param policy the policy, copied.
+ * @return 1 if succeeded, 0 otherwise (the map keeps its previous policy).
+ */
+int hashmap_set_bucket_policy (hashmap *hash_map, const bucket_policy *policy)
+{
+  if (hash_map == NULL || policy == NULL)
+    {
+      return 0;
+    }
+  hashmap_state *state = state_of(hash_map);
+  bucket_policy previous = state->policy;
+  state->policy = *policy;
+  if (state->pool == NULL && policy->flags != BUCKET_ALLOC_DEFAULT
+      && pool_adopt(hash_map) == 0)
+    {
+      state->policy = previous;
+      return 0;
+    }
+  if (policy->flags & BUCKET_ALLOC_NUMA_BIND)
+    {
+      // a malloc backed array is small, the next rehash places its successor
+      bucket_alloc_bind(hash_map->buckets, hash_map->capacity,
+                        sizeof(void *), policy->node);
+      unsigned char *chunk = NULL;
+      for (chunk = state->pool->chunks; chunk != NULL;
+           chunk = *(unsigned char **) chunk)
+        {
+          bucket_alloc_bind(chunk, SLOT_POOL_CHUNK, 1, policy->node);
+        }
+    }
+  return 1;
+}
+/**
+ * Charges a hash map to an account from now on. Its pairs are walked once,
+ * as accounts may count keys and values differently, and the bytes it
+ * holds move from its previous account to the new one.
+ * @param hash_map a hash map.
+ * @param account the account, NULL to stop accounting the map.
+ * @return 1 if succeeded, 0 otherwise (also if the map does not fit in the
+ * account's budget, it then stays with its previous account).
+ */
+int hashmap_set_account (hashmap *hash_map, hashmap_account *account)
+{
+  if (hash_map == NULL)
+    {
+      return 0;
+    }
+  hashmap_state *state = state_of(hash_map);
+  if (account == state->account)
+    {
+      return 1;
+    }
+  size_t bytes = state->bytes;
+  size_t i = 0;
+  size_t j = 0;
+  for (i = 0; i < hash_map->capacity; i++)
+    {
+      vector *bucket = hash_map->buckets[i];
+      for (j = 0; bucket != NULL && j < bucket->size; j++)
+        {
+          bytes -= charged_bytes(bucket->data[j]);
+          bytes += account_pair_bytes(account, bucket->data[j]);
+        }
+    }
+  if (account_charge(account, bytes) == 0)
+    {
+      return 0;
+    }
+  account_release(state->account, state->bytes);
+  state->account = account;
+  state->bytes = bytes;
+  for (i = 0; i < hash_map->capacity; i++)
+    {
+      vector *bucket = hash_map->buckets[i];
+      for (j = 0; bucket != NULL && j < bucket->size; j++)
+        {
+          hashed_pair *a = bucket->data[j];
+          a->bytes = account_pair_bytes(account, &a->pair);
+        }
+    }
+  return 1;
+}
+
+/**
+ * @param hash_map a hash map.
+ * @return the bytes the map holds, counted as by its account (without one,
+ * keys and values count nothing), 0 if hash_map is NULL.
+ */
+size_t hashmap_memory (const hashmap *hash_map)
+{
+  if (hash_map == NULL)
+    {
+      return 0;
+    }
+  return state_of(hash_map)->bytes;
+}
+
+keyT get_key (const hashmap *hash_map, size_t bucket_ind, size_t data_ind)
+{
+  pair *a = (pair *) (hash_map->buckets[bucket_ind]->data[data_ind]);
+  return a->key;
+}
+
+// Returns a copy of in_pair carrying the full hash of its key, NULL if
+// failed.
+pair *hashed_pair_copy (const pair *in_pair, size_t hash)
+{
+  hashed_pair *copy = malloc(sizeof(*copy));
+  if (copy == NULL)
+    {
+      return NULL;
+    }
+  copy->pair = *in_pair;
+  copy->hash = hash;
+  copy->bytes = 0;
+  copy->pair.key = in_pair->key_cpy(in_pair->key);
+  copy->pair.value = in_pair->value_cpy(in_pair->value);
+  if (copy->pair.key == NULL || copy->pair.value == NULL)
+    {
+      if (copy->pair.key != NULL)
+        {
+          copy->pair.key_free(&copy->pair.key);
+        }
+      if (copy->pair.value != NULL)
+        {
+          copy->pair.value_free(&copy->pair.value);
+        }
+      free(copy);
+      return NULL;
+    }
+  return &copy->pair;
+}
+
+// Returns the full hash of the key at the given position of a bucket.
+size_t get_hash (const vector *bucket, size_t ind)
+{
+  return ((const hashed_pair *) bucket->data[ind])->hash;
+}
+
+// Moves the pair at position ind of a bucket into place in the sorted
+// prefix [0, ind), binary searching on the full hash.
+void sort_into_place (vector *bucket, size_t ind)
+{
+  size_t hash = get_hash(bucket, ind);
+  size_t low = 0;
+  size_t high = ind;
+  while (low < high)
+    {
+      size_t mid = low + (high - low) / 2;
+      if (get_hash(bucket, mid) <= hash)
+        {
+          low = mid + 1;
+        }
+      else
+        {
+          high = mid;
+        }
+    }
+  void *moved = bucket->data[ind];
+  memmove(&bucket->data[low + 1], &bucket->data[low],
+          (ind - low) * sizeof(void *));
+  bucket->data[low] = moved;
+}
+
+// Keeps a bucket sorted after a pair was pushed to its back. A chain that
+// just grew past HASH_MAP_SORTED_CHAIN_LEN is sorted as a whole.
+void sort_chain (vector *bucket)
+{
+  if (bucket->size <= HASH_MAP_SORTED_CHAIN_LEN)
+    {
+      return;
+    }
+  size_t i = bucket->size - 1;
+  if (bucket->size == HASH_MAP_SORTED_CHAIN_LEN + 1)
+    {
+      i = 1;
+    }
+  for (; i < bucket->size; i++)
+    {
+      sort_into_place(bucket, i);
+    }
+}
+
+// Returns the position of key, whose full hash is hash, in the given
+// bucket, -1 if it is not there. Only keys of the same hash are compared.
+int find_in_bucket (const vector *bucket, size_t hash, const_keyT key)
+{
+  if (bucket == NULL)
+    {
+      return -1;
+    }
+  size_t j = 0;
+  if (bucket->size > HASH_MAP_SORTED_CHAIN_LEN)
+    {
+      size_t high = bucket->size;
+      while (j < high)
+        {
+          size_t mid = j + (high - j) / 2;
+          if (get_hash(bucket, mid) < hash)
+            {
+              j = mid + 1;
+            }
+          else
+            {
+              high = mid;
+            }
+        }
+    }
+  for (; j < bucket->size; j++)
+    {
+      pair *a = (pair *) (bucket->data[j]);
+      if (a == NULL)
+        {
+          continue;
+        }
+      size_t a_hash = get_hash(bucket, j);
+      if (bucket->size > HASH_MAP_SORTED_CHAIN_LEN && a_hash != hash)
+        {
+          return -1;
+        }
+      if (a_hash == hash && a->key_cmp(a->key, key) == 1)
+        {
+          return (int) j;
+        }
+    }
+  return -1;
+}
+
+// Frees the pair at position ind of a bucket of a hashmap and closes the
+// gap. Unlike vector_erase it never reallocs, the slot capacity is kept for
+// the next insert into this bucket.
+void bucket_remove (hashmap *hash_map, vector *bucket, size_t ind)
+{
+  map_release(hash_map, charged_bytes(bucket->data[ind]));
+  bucket->elem_free_func(&bucket->data[ind]);
+  memmove(&bucket->data[ind], &bucket->data[ind + 1],
+          (bucket->size - ind - 1) * sizeof(void *));
+  bucket->size--;
+  bucket->data[bucket->size] = NULL;
+}
+
+// Pairs land in new bucket hash & (new_capacity - 1), so with both
+// capacities powers of two, the buckets sharing their index modulo the
+// smaller capacity only ever exchange pairs among themselves. A rehash is
+// split into such residue classes, each handled by one rehash_task.
+typedef struct rehash_task {
+    hashmap *hash_map;
+    vector **new_buckets;
+    size_t *counts;
+    size_t new_capacity;
+    size_t low;
+    size_t high;
+    size_t charged;
+    size_t released;
+    int check;
+} rehash_task;
+
+/**
+ * Sets the number of threads rehashing the map's tables of at least
+ * HASH_MAP_PARALLEL_MIN_CAP buckets (smaller ones are always rehashed by
+ * the calling thread).
+ * @param hash_map a hash map.
+ * @param threads the number of threads, 1 (the default) rehashes serially,
+ * capped at HASH_MAP_MAX_REHASH_THREADS.
+ * @return 1 if succeeded, 0 otherwise.
+ */
+int hashmap_set_rehash_threads (hashmap *hash_map, size_t threads)
+{
+  if (hash_map == NULL)
+    {
+      return 0;
+    }
+  if (threads == 0)
+    {
+      threads = 1;
+    }
+  if (threads > HASH_MAP_MAX_REHASH_THREADS)
+    {
+      threads = HASH_MAP_MAX_REHASH_THREADS;
+    }
+  state_of(hash_map)->rehash_threads = threads;
+  return 1;
+}
+
+// Returns the slots a new bucket of count pairs is allocated with.
+size_t rehash_bucket_cap (size_t count)
+{
+  size_t cap = VECTOR_INITIAL_CAP;
+  while (count > cap * VECTOR_MAX_LOAD_FACTOR)
+    {
+      cap = cap * VECTOR_GROWTH_FACTOR;
+    }
+  return cap;
+}
+
+// Counts the pairs of the task's residue classes per new bucket and
+// allocates every new bucket with enough slots, so nothing can fail once
+// pairs move. Sets check to 0 if an allocation failed. The bytes allocated
+// add up in charged, hash_resize charges them once every task is done.
+// A map with a pool only counts here, hash_resize then allocates the
+// buckets from the pool itself.
+void *rehash_prepare (void *arg)
+{
+  rehash_task *task = arg;
+  hashmap *hash_map = task->hash_map;
+  int has_pool = state_of(hash_map)->pool != NULL;
+  size_t step = hash_map->capacity;
+  if (task->new_capacity < step)
+    {
+      step = task->new_capacity;
+    }
+  size_t r = 0;
+  size_t i = 0;
+  size_t j = 0;
+  for (r = task->low; r < task->high; r++)
+    {
+      for (i = r; i < hash_map->capacity; i += step)
+        {
+          vector *bucket = hash_map->buckets[i];
+          for (j = 0; bucket != NULL && j < bucket->size; j++)
+            {
+              task->counts[get_hash(bucket, j)
+                           & (task->new_capacity - 1)]++;
+            }
+        }
+      for (i = r; i < task->new_capacity && !has_pool; i += step)
+        {
+          if (task->counts[i] == 0)
+            {
+              continue;
+            }
+          task->new_buckets[i] = bucket_vector_alloc(
+              hash_map, rehash_bucket_cap(task->counts[i]), &task->charged);
+          if (task->new_buckets[i] == NULL)
+            {
+              task->check = 0;
+              return NULL;
+            }
+        }
+    }
+  return NULL;
+}
+
+// Moves the pairs of the task's residue classes to the new buckets (the
+// pairs are moved, not copied) and frees the old vectors, adding their
+// bytes up in released.
+void *rehash_move (void *arg)
+{
+  rehash_task *task = arg;
+  hashmap *hash_map = task->hash_map;
+  size_t step = hash_map->capacity;
+  if (task->new_capacity < step)
+    {
+      step = task->new_capacity;
+    }
+  size_t r = 0;
+  size_t i = 0;
+  size_t j = 0;
+  for (r = task->low; r < task->high; r++)
+    {
+      for (i = r; i < hash_map->capacity; i += step)
+        {
+          vector *bucket = hash_map->buckets[i];
+          for (j = 0; bucket != NULL && j < bucket->size; j++)
+            {
+              size_t index = get_hash(bucket, j)
+                             & (task->new_capacity - 1);
+              vector *target = task->new_buckets[index];
+              target->data[target->size] = bucket->data[j];
+              target->size++;
+              sort_chain(target);
+            }
+          if (bucket != NULL)
+            {
+              // the pairs live on in new_buckets, free only the vector
+              bucket_vector_free(hash_map, &hash_map->buckets[i],
+                                 &task->released);
+            }
+        }
+    }
+  return NULL;
+}
+
+// Runs func on every task, on worker threads when there are several. A
+// task whose thread could not start runs on the calling thread.
+void rehash_run (rehash_task *tasks, size_t count, void *(*func) (void *))
+{
+  pthread_t threads[HASH_MAP_MAX_REHASH_THREADS];
+  int started[HASH_MAP_MAX_REHASH_THREADS];
+  size_t t = 0;
+  for (t = 1; t < count; t++)
+    {
+      started[t] = pthread_create(&threads[t], NULL, func, &tasks[t]) == 0;
+      if (!started[t])
+        {
+          func(&tasks[t]);
+        }
+    }
+  func(&tasks[0]);
+  for (t = 1; t < count; t++)
+    {
+      if (started[t])
+        {
+          pthread_join(threads[t], NULL);
+        }
+    }
+}
+
+// Rehashes a hashmap into new_capacity buckets (a power of two).
+// The pairs are moved to the new buckets, not copied. Large tables are
+// split across the map's rehash threads by residue class.
+// returns 0 if failed, 1 if succeeded
+int hash_resize (hashmap *hash_map, size_t new_capacity)
+{
+  vector **new_buckets = table_alloc(hash_map, new_capacity);
+  size_t counts_bytes = sizeof(size_t) * new_capacity;
+  size_t *counts = NULL;
+  if (new_buckets != NULL && map_charge(hash_map, counts_bytes) == 1)
+    {
+      counts = calloc(sizeof(size_t), new_capacity);
+      if (counts == NULL)
+        {
+          map_release(hash_map, counts_bytes);
+        }
+    }
+  if (counts == NULL)
+    {
+      table_free(hash_map, new_buckets, new_capacity);
+      return 0;
+    }
+  size_t classes = hash_map->capacity;
+  if (new_capacity < classes)
+    {
+      classes = new_capacity;
+    }
+  size_t count = 1;
+  if (classes >= HASH_MAP_PARALLEL_MIN_CAP)
+    {
+      count = state_of(hash_map)->rehash_threads;
+    }
+  rehash_task tasks[HASH_MAP_MAX_REHASH_THREADS];
+  size_t t = 0;
+  for (t = 0; t < count; t++)
+    {
+      tasks[t].hash_map = hash_map;
+      tasks[t].new_buckets = new_buckets;
+      tasks[t].counts = counts;
+      tasks[t].new_capacity = new_capacity;
+      tasks[t].low = classes * t / count;
+      tasks[t].high = classes * (t + 1) / count;
+      tasks[t].charged = 0;
+      tasks[t].released = 0;
+      tasks[t].check = 1;
+    }
+  rehash_run(tasks, count, rehash_prepare);
+  int check = 1;
+  size_t charged = 0;
+  for (t = 0; t < count; t++)
+    {
+      check = check && tasks[t].check;
+      charged += tasks[t].charged;
+    }
+  int has_pool = state_of(hash_map)->pool != NULL;
+  for (t = 0; t < new_capacity && check && has_pool; t++)
+    {
+      if (counts[t] != 0)
+        {
+          new_buckets[t] = bucket_vector_alloc(
+              hash_map, rehash_bucket_cap(counts[t]), NULL);
+          check = new_buckets[t] != NULL;
+        }
+    }
+  free(counts);
+  map_release(hash_map, counts_bytes);
+  // the workers never touch the map's counters, the new vectors are
+  // charged here at once (a budget they exceed fails the rehash)
+  if (!check || map_charge(hash_map, charged) == 0)
+    {
+      // bytes tallied by the workers were never charged
+      size_t discarded = 0;
+      for (t = 0; t < new_capacity; t++)
+        {
+          bucket_vector_free(hash_map, &new_buckets[t],
+                             has_pool ? NULL : &discarded);
+        }
+      table_free(hash_map, new_buckets, new_capacity);
+      return 0;
+    }
+  rehash_run(tasks, count, rehash_move);
+  for (t = 0; t < count; t++)
+    {
+      map_release(hash_map, tasks[t].released);
+    }
+  table_free(hash_map, hash_map->buckets, hash_map->capacity);
+  hash_map->buckets = new_buckets;
+  hash_map->capacity = new_capacity;
+  return 1;
+}
+
+// This function updates a hashmap in case it needs to be rehashed
+// gets a hashmap and a direction - increase for 1, otherwise to decrease the
+// capacity of the hashmap.
+// returns 0 if failed, 1 if succeeded
+int hash_update (hashmap *hash_map, int dir)
+{
+  size_t new_capacity = hash_map->capacity / HASH_MAP_GROWTH_FACTOR;
+  if (dir == 1)
+    {
+      new_capacity = hash_map->capacity * HASH_MAP_GROWTH_FACTOR;
+    }
+  return hash_resize(hash_map, new_capacity);
+}
+//* This function returns the load factor of the vector.
+//* @param vector a vector.
+//* @param add - increase aor decrease the load factor in advanced
+//* @return the vector's load factor, -1 if the function failed.
+//*/
+double pre_hashmap_get_load_factor(const hashmap *hash_map, int add)
+{
+  if (hash_map == NULL)
+    {
+      return -1;
+    }
+  double cap = hash_map->capacity;
+  double size = hash_map->size;
+  double load = ((size + add) / cap);
+  return load;
+}
+// Returns the bytes inserting in_pair allocates: the pair, its bucket's
+// vector or slot growth, and when the insert rehashes, the new bucket array
+// with its scratch counts and its new vectors (as if every pair got a
+// bucket of its own, the old vectors are only freed after).
+size_t insert_bytes (const hashmap *hash_map, size_t hash, size_t pair_bytes)
+{
+  if (pre_hashmap_get_load_factor(hash_map, 1) > HASH_MAP_MAX_LOAD_FACTOR)
+    {
+      size_t new_capacity = hash_map->capacity * HASH_MAP_GROWTH_FACTOR;
+      size_t vectors = hash_map->size + 1;
+      if (vectors > new_capacity)
+        {
+          vectors = new_capacity;
+        }
+      return pair_bytes + new_capacity * (sizeof(void *) + sizeof(size_t))
+             + vectors * (sizeof(vector) + VECTOR_INITIAL_CAP
+                                           * sizeof(void *));
+    }
+  vector *bucket = hash_map->buckets[hash & (hash_map->capacity - 1)];
+  if (bucket == NULL)
+    {
+      return pair_bytes + sizeof(vector) + VECTOR_INITIAL_CAP * sizeof(void *);
+    }
+  if (bucket->size + 1 > bucket->capacity * VECTOR_MAX_LOAD_FACTOR)
+    {
+      return pair_bytes + bucket->capacity * (VECTOR_GROWTH_FACTOR - 1)
+                          * sizeof(void *);
+    }
+  return pair_bytes;
+}
+
+// Returns the position right after the group of key starting at first,
+// the bucket's size if there is no group (first is (size_t) -1).
+size_t group_end (const vector *bucket, size_t first, const_keyT key)
+{
+  if (first == (size_t) -1)
+    {
+      return bucket->size;
+    }
+  size_t end = first + 1;
+  while (end < bucket->size)
+    {
+      pair *a = (pair *) bucket->data[end];
+      if (a->key_cmp(a->key, key) != 1)
+        {
+          break;
+        }
+      end++;
+    }
+  return end;
+}
+
+// Makes room for count more pairs in a bucket of a hashmap, growing its
+// slot array as vector_push_back would.
+// returns 0 if failed, 1 if succeeded
+int bucket_reserve (const hashmap *hash_map, vector *bucket, size_t count)
+{
+  if (bucket->size + count <= bucket->capacity * VECTOR_MAX_LOAD_FACTOR)
+    {
+      return 1;
+    }
+  size_t cap = bucket->capacity;
+  while (bucket->size + count > cap * VECTOR_MAX_LOAD_FACTOR)
+    {
+      cap = cap * VECTOR_GROWTH_FACTOR;
+    }
+  void **data = block_resize(hash_map, bucket->data,
+                             sizeof(void *) * bucket->capacity,
+                             sizeof(void *) * cap);
+  if (data == NULL)
+    {
+      return 0;
+    }
+  bucket->data = data;
+  bucket->capacity = cap;
+  return 1;
+}
+
+// Inserts a copy of in_pair, which the caller checked, hash being the full
+// hash of its key. With multi set its key may already be there: the pair
+// then goes right after the pairs of that key, so the pairs of one key
+// always form a contiguous group.
+// returns 0 if failed, 1 if succeeded
+int insert_copy (hashmap *hash_map, const pair *in_pair, size_t hash,
+                 int multi)
+{
+  size_t pair_bytes = map_pair_bytes(hash_map, in_pair);
+  hashmap_account *account = state_of(hash_map)->account;
+  if (account != NULL
+      && account_make_room(account, insert_bytes(hash_map, hash, pair_bytes))
+         == 0)
+    {
+      return 0;
+    }
+  // hash_update builds the grown bucket array itself, the old one is only
+  // read and then released.
+  if (pre_hashmap_get_load_factor(hash_map, 1) > HASH_MAP_MAX_LOAD_FACTOR)
+    {
+      if (hash_update(hash_map, 1) == 0)
+        {
+          return 0;
+        }
+    }
+  size_t index = hash & (hash_map->capacity - 1);
+  if (hash_map->buckets[index] == NULL || ((hash_map->buckets[index] != NULL)
+  && (hash_map->buckets[index]->data[0] == NULL)
+  && (hash_map->buckets[index]->size > 0)))
+    {
+      hash_map->buckets[index] = bucket_vector_alloc(hash_map,
+                                                     VECTOR_INITIAL_CAP,
+                                                     NULL);
+      if (hash_map->buckets[index] == NULL)
+        {
+          return 0;
+        }
+    }
+  vector *bucket = hash_map->buckets[index];
+  int first = -1;
+  if (multi)
+    {
+      first = find_in_bucket(bucket, hash, in_pair->key);
+    }
+  size_t end = group_end(bucket, (size_t) first, in_pair->key);
+  if (map_charge(hash_map, pair_bytes) == 0)
+    {
+      return 0;
+    }
+  pair *copy = NULL;
+  if (bucket_reserve(hash_map, bucket, 1) == 1)
+    {
+      copy = hashed_pair_copy(in_pair, hash);
+    }
+  if (copy == NULL)
+    {
+      map_release(hash_map, pair_bytes);
+      return 0;
+    }
+  ((hashed_pair *) copy)->bytes = pair_bytes;
+  bucket->data[bucket->size] = copy;
+  bucket->size++;
+  if (first == -1)
+    {
+      sort_chain(bucket);
+    }
+  else
+    {
+      // same key, same hash: the end of the group keeps a chain sorted
+      memmove(&bucket->data[end + 1], &bucket->data[end],
+              (bucket->size - 1 - end) * sizeof(void *));
+      bucket->data[end] = copy;
+      if (bucket->size == HASH_MAP_SORTED_CHAIN_LEN + 1)
+        {
+          sort_chain(bucket);
+        }
+    }
+  hash_map->size++;
+  return 1;
+}
+
+
+/**
+ * Inserts a new in_pair to the hash map.
+ * The function inserts *new*, *copied*, *dynamically allocated* in_pair,
+ * NOT the in_pair it receives as a parameter.
+ * @param hash_map the hash map to be inserted with new element.
+ * @param in_pair a in_pair the hash map would contain.
+ * @return returns 1 for successful insertion, 0 otherwise.
+ */
+int hashmap_insert (hashmap *hash_map, const pair *in_pair)
+{
+  if (hash_map == NULL || in_pair == NULL || in_pair->key == NULL ||
+  in_pair->value == NULL)
+    {
+      return 0;
+    }
+  size_t hash = hashmap_hash(hash_map, in_pair->key);
+  vector *bucket = hash_map->buckets[hash & (hash_map->capacity - 1)];
+  if (find_in_bucket(bucket, hash, in_pair->key) != -1)
+    {
+      return 0;
+    }
+  return insert_copy(hash_map, in_pair, hash, 0);
+}
+
+/**
+ * The function returns the value associated with the given key.
+ * @param hash_map a hash map.
+ * @param key the key to be checked.
+ * @return the value associated with key if exists, NULL otherwise
+ * (the value itself,
+ * not a copy of it).
+ */
+valueT hashmap_at (const hashmap *hash_map, const_keyT key)
+{
+  pair *found = hashmap_find(hash_map, key);
+  if (found == NULL)
+    {
+      return NULL;
+    }
+  return found->value;
+}
+
+/**
+ * Returns the pair the hash map holds for the given key, e.g. to reach the
+ * map's own copy of the key.
+ * @param hash_map a hash map.
+ * @param key the key to be checked.
+ * @return the pair if exists (the pair itself, not a copy of it), NULL
+ * otherwise.
+ */
+pair *hashmap_find (const hashmap *hash_map, const_keyT key)
+{
+  if (hash_map == NULL || key == NULL)
+    {
+      return NULL;
+    }
+  return hashmap_find_hashed(hash_map, key, hashmap_hash(hash_map, key));
+}
+
+/**
+ * Returns the pair the hash map holds for the given key, whose full hash
+ * (see hashmap_hash) the caller already has.
+ * @param hash_map a hash map.
+ * @param key the key to be checked.
+ * @param hash the full hash of key.
+ * @return the pair if exists (the pair itself, not a copy of it), NULL
+ * otherwise.
+ */
+pair *hashmap_find_hashed (const hashmap *hash_map, const_keyT key,
+                           size_t hash)
+{
+  if (hash_map == NULL || key == NULL)
+    {
+      return NULL;
+    }
+  vector *bucket = hash_map->buckets[hash & (hash_map->capacity - 1)];
+  int ind = find_in_bucket(bucket, hash, key);
+  if (ind == -1)
+    {
+      return NULL;
+    }
+  return (pair *) bucket->data[ind];
+}
+
+/**
+ * Replaces the value of the pair of key by a copy of value, charging the
+ * difference in size to the map's account.
+ * @param hash_map a hash map.
+ * @param key the key of the pair.
+ * @param value the new value.
+ * @return 1 if succeeded, 0 otherwise (also if key is not in the map or
+ * the new value does not fit in the account's budget, the old value then
+ * stays).
+ */
+int hashmap_set_value (hashmap *hash_map, const_keyT key, const_valueT value)
+{
+  pair *found = hashmap_find(hash_map, key);
+  if (found == NULL || value == NULL)
+    {
+      return 0;
+    }
+  size_t old_bytes = charged_bytes(found);
+  valueT old = found->value;
+  found->value = found->value_cpy(value);
+  if (found->value == NULL)
+    {
+      found->value = old;
+      return 0;
+    }
+  size_t new_bytes = map_pair_bytes(hash_map, found);
+  if (new_bytes > old_bytes
+      && map_charge(hash_map, new_bytes - old_bytes) == 0)
+    {
+      found->value_free(&found->value);
+      found->value = old;
+      return 0;
+    }
+  if (new_bytes < old_bytes)
+    {
+      map_release(hash_map, old_bytes - new_bytes);
+    }
+  ((hashed_pair *) found)->bytes = new_bytes;
+  found->value_free(&old);
+  return 1;
+}
+
+/**
+ * The function erases the pair associated with key. The bucket array is
+ * never shrunk here, hashmap_compact releases it.
+ * @param hash_map a hash map.
+ * @param key a key of the pair to be erased.
+ * @return 1 if the erasing was done successfully, 0 otherwise.
+ * (if key not in map,
+ * considered fail).
+ */
+int hashmap_erase (hashmap *hash_map, const_keyT key)
 {
-  if (func == NULL)
+  if (hash_map == NULL || key == NULL)
     {
-      return NULL;
+      return 0;
     }
-  hashmap *table = calloc(sizeof(*table), 1);
-  if (table == NULL)
+  size_t hash = hashmap_hash(hash_map, key);
+  vector *bucket = hash_map->buckets[hash & (hash_map->capacity - 1)];
+  int ind = find_in_bucket(bucket, hash, key);
+  if (ind == -1)
     {
-      return NULL;
+      return 0;
     }
-  table->size = 0;
-  table->capacity = HASH_MAP_INITIAL_CAP;
-  table->hash_func = func;
-  table->buckets = calloc(sizeof(void *), table->capacity);
-  if (table->buckets == NULL)
+  // An emptied bucket keeps its vector and the table its capacity, so
+  // erasing never rehashes, see hashmap_compact.
+  bucket_remove(hash_map, bucket, ind);
+  hash_map->size--;
+  return 1;
+}
+
+// Shrinks the bucket array, in one rehash, until the load factor is no more
+// under the minimal one, but never under HASH_MAP_INITIAL_CAP buckets.
+// returns 0 if failed (the map is left as it was), 1 if succeeded
+int shrink_to_fit (hashmap *hash_map)
+{
+  size_t new_capacity = hash_map->capacity;
+  while (new_capacity > HASH_MAP_INITIAL_CAP
+         && hash_map->size < new_capacity * VECTOR_MIN_LOAD_FACTOR)
     {
-      free(table);
-      return NULL;
+      new_capacity = new_capacity / HASH_MAP_GROWTH_FACTOR;
     }
-  return table;
+  if (new_capacity == hash_map->capacity)
+    {
+      return 1;
+    }
+  return hash_resize(hash_map, new_capacity);
 }
 
 /**
- * Frees a hash map and the elements the hash map itself allocated.
- * @param p_hash_map pointer to dynamically allocated pointer to hash_map.
+ * Releases the memory erasing keeps around for reuse: shrinks the bucket
+ * array, in one rehash, while the load factor is under the minimal one
+ * (down to HASH_MAP_INITIAL_CAP buckets), frees the vectors of empty
+ * buckets and trims the slot arrays of the others.
+ * @param hash_map a hash map.
+ * @return 1 if succeeded, 0 otherwise (the map stays valid).
  */
-void hashmap_free (hashmap **p_hash_map)
+int hashmap_compact (hashmap *hash_map)
 {
+  if (hash_map == NULL)
+    {
+      return 0;
+    }
+  if (shrink_to_fit(hash_map) == 0)
+    {
+      return 0;
+    }
   size_t i = 0;
-  while (i < (*p_hash_map)->capacity)
+  for (i = 0; i < hash_map->capacity; i++)
     {
-      vector_free(&((*p_hash_map)->buckets[i]));
-      i++;
+      vector *bucket = hash_map->buckets[i];
+      if (bucket == NULL)
+        {
+          continue;
+        }
+      if (bucket->size == 0)
+        {
+          bucket_vector_free(hash_map, &hash_map->buckets[i], NULL);
+          continue;
+        }
+      size_t cap = bucket->capacity;
+      while (cap > 1 && bucket->size < cap * VECTOR_MIN_LOAD_FACTOR)
+        {
+          cap = cap / VECTOR_GROWTH_FACTOR;
+        }
+      if (cap != bucket->capacity)
+        {
+          void **data = block_resize(hash_map, bucket->data,
+                                     sizeof(void *) * bucket->capacity,
+                                     sizeof(void *) * cap);
+          if (data == NULL)
+            {
+              return 0;
+            }
+          bucket->data = data;
+          bucket->capacity = cap;
+        }
     }
-  free((*p_hash_map)->buckets);
-  free(*p_hash_map);
-  *p_hash_map = NULL;
+  return 1;
 }
-keyT get_key (const hashmap *hash_map, size_t bucket_ind, size_t data_ind)
+
+/**
+ * Grows the bucket array, in one rehash, so that count pairs fit under the
+ * maximal load factor without any further rehash.
+ * @param hash_map a hash map.
+ * @param count the number of pairs the map should be able to hold.
+ * @return 1 if succeeded (also if no growth was needed), 0 otherwise (the
+ * map stays as it was).
+ */
+int hashmap_reserve (hashmap *hash_map, size_t count)
 {
-  pair *a = (pair *) (hash_map->buckets[bucket_ind]->data[data_ind]);
-  return a->key;
+  if (hash_map == NULL)
+    {
+      return 0;
+    }
+  size_t new_capacity = hash_map->capacity;
+  while (count > new_capacity * HASH_MAP_MAX_LOAD_FACTOR)
+    {
+      new_capacity = new_capacity * HASH_MAP_GROWTH_FACTOR;
+    }
+  if (new_capacity == hash_map->capacity)
+    {
+      return 1;
+    }
+  return hash_resize(hash_map, new_capacity);
 }
 
-// This function gets a dynamically allocated hash_map and null specific part
-// of it
-void null_it (hashmap *hash_map, size_t start)
+/**
+ * Inserts copies of many pairs, growing the bucket array once up front
+ * (see hashmap_reserve) instead of rehashing along the way.
+ * @param hash_map the hash map to be inserted with new elements.
+ * @param pairs the pairs to insert.
+ * @param count the number of pairs.
+ * @return the number of pairs inserted (pairs whose key is already in the
+ * map are skipped, as by hashmap_insert).
+ */
+size_t hashmap_insert_all (hashmap *hash_map, pair *const *pairs,
+                           size_t count)
 {
-  if (start == 0)
+  if (hash_map == NULL || pairs == NULL)
     {
-      size_t i = 0;
-      for (i = 0; i < hash_map->capacity; i++)
-        {
-          hash_map->buckets[i] = NULL;
-        }
+      return 0;
     }
-  else
+  // a failed reservation only means the inserts rehash as they go
+  hashmap_reserve(hash_map, hash_map->size + count);
+  size_t inserted = 0;
+  size_t i = 0;
+  for (i = 0; i < count; i++)
+    {
+      inserted += hashmap_insert(hash_map, pairs[i]);
+    }
+  return inserted;
+}
+
+// Makes room for count more pairs in bucket index of a hashmap, allocating
+// the bucket if needed.
+// returns 0 if failed, 1 if succeeded
+int bucket_make_room (hashmap *hash_map, size_t index, size_t count)
+{
+  if (hash_map->buckets[index] == NULL)
     {
-      for (; start < hash_map->capacity * HASH_MAP_GROWTH_FACTOR; start++)
+      hash_map->buckets[index] = bucket_vector_alloc(hash_map,
+                                                     VECTOR_INITIAL_CAP,
+                                                     NULL);
+      if (hash_map->buckets[index] == NULL)
         {
-          hash_map->buckets[start] = NULL;
+          return 0;
         }
     }
+  return bucket_reserve(hash_map, hash_map->buckets[index], count);
 }
 
-// This function updates a hashmap in case it needs to be rehashed
-// gets a hashmap and a direction - increase for 1, otherwise to decrease the
-// capacity of the hashmap.
-// returns 0 if failed, 1 if succeeded
-int hash_update (hashmap *hash_map, int dir)
+// Appends a group of count pairs of one key, whose full hash in this map
+// is hash, to bucket index of a hashmap without copying them. The group
+// stays contiguous and in order. bucket_make_room must have made room, and
+// the caller charged the pairs as group_cost counts them.
+void bucket_append_group (hashmap *hash_map, size_t index, void **group,
+                          size_t count, size_t hash)
 {
-  hashmap *new_hash = hashmap_alloc(hash_map->hash_func);
-  if (new_hash == NULL)
+  vector *bucket = hash_map->buckets[index];
+  size_t k = 0;
+  for (k = 0; k < count; k++)
     {
-      return 0;
+      // the hash cached with the pair is now this map's
+      ((hashed_pair *) group[k])->hash = hash;
+      ((hashed_pair *) group[k])->bytes = map_pair_bytes(hash_map, group[k]);
+      bucket->data[bucket->size] = group[k];
+      bucket->size++;
+      sort_chain(bucket);
     }
-  hashmap *new_hash_2 = hashmap_alloc(hash_map->hash_func);
-  if (new_hash_2 == NULL)
+  hash_map->size += count;
+}
+
+// Returns the bytes a group of count pairs stored in a hashmap was
+// charged.
+size_t group_bytes (void *const *group, size_t count)
+{
+  size_t bytes = 0;
+  size_t k = 0;
+  for (k = 0; k < count; k++)
     {
-      free(new_hash->buckets);
-      free(new_hash);
-      return 0;
+      bytes += charged_bytes(group[k]);
     }
-  new_hash_2->size = hash_map->size;
-  if (dir == 1)
+  return bytes;
+}
+
+// Returns the bytes a group of count pairs would be charged in a hashmap.
+size_t group_cost (const hashmap *hash_map, void *const *group,
+                   size_t count)
+{
+  size_t bytes = 0;
+  size_t k = 0;
+  for (k = 0; k < count; k++)
     {
-      new_hash->capacity = hash_map->capacity * HASH_MAP_GROWTH_FACTOR;
+      bytes += map_pair_bytes(hash_map, group[k]);
     }
-  else
+  return bytes;
+}
+
+// Frees the count pairs of the group at position first of a bucket of a
+// hashmap and closes the gap. The caller releases the bytes the pairs were
+// charged, which this returns.
+size_t bucket_remove_group (vector *bucket, size_t first, size_t count)
+{
+  size_t bytes = group_bytes(&bucket->data[first], count);
+  size_t j = 0;
+  for (j = first; j < first + count; j++)
+    {
+      bucket->elem_free_func(&bucket->data[j]);
+    }
+  memmove(&bucket->data[first], &bucket->data[first + count],
+          (bucket->size - first - count) * sizeof(void *));
+  memset(&bucket->data[bucket->size - count], 0, count * sizeof(void *));
+  bucket->size -= count;
+  return bytes;
+}
+
+// Replaces the emptied bucket array of a hashmap by a fresh one of
+// HASH_MAP_INITIAL_CAP buckets. If that cannot be allocated, the emptied
+// buckets are kept, which is still a valid empty map.
+void table_reset (hashmap *hash_map)
+{
+  vector **fresh = table_alloc(hash_map, HASH_MAP_INITIAL_CAP);
+  if (fresh == NULL)
+    {
+      return;
+    }
+  size_t i = 0;
+  for (i = 0; i < hash_map->capacity; i++)
     {
-      new_hash->capacity = hash_map->capacity / HASH_MAP_GROWTH_FACTOR;
+      bucket_vector_free(hash_map, &hash_map->buckets[i], NULL);
     }
-  new_hash->buckets = realloc(new_hash->buckets, sizeof(void*)
-  * (new_hash->capacity));
-  if (new_hash == NULL)
+  table_free(hash_map, hash_map->buckets, hash_map->capacity);
+  hash_map->buckets = fresh;
+  hash_map->capacity = HASH_MAP_INITIAL_CAP;
+}
+
+/**
+ * Moves every pair of src into dst. The pairs themselves are moved, not
+ * copied. dst is grown once up front, so merging never rehashes pair by
+ * pair. Multimaps are merged key by key: the group of pairs of a key moves
+ * whole, and a conflict keeps one of the two groups whole.
+ * @param dst the hash map receiving the pairs.
+ * @param src the hash map giving them away, left empty with
+ * HASH_MAP_INITIAL_CAP buckets if the merge succeeded.
+ * @param conflict_fn called when a key of src is already in dst, with the
+ * first pair of each group, returns 1 for src's pairs to replace dst's, 0
+ * to keep dst's (it may update dst's value from src's first). The losing
+ * pairs are freed. NULL keeps dst's.
+ * @return 1 if succeeded, 0 otherwise, also when dst's account has no room
+ * left for the pairs (every pair is then still in either dst or src).
+ */
+int hashmap_merge (hashmap *dst, hashmap *src,
+                   hashmap_conflict_func conflict_fn)
+{
+  if (dst == NULL || src == NULL || dst == src
+      || hashmap_reserve(dst, dst->size + src->size) == 0)
     {
-      free(new_hash->buckets);
-      free(new_hash);
-      free(new_hash_2->buckets);
-      free(new_hash_2);
       return 0;
     }
-  null_it(new_hash, 0);
   size_t i = 0;
   size_t j = 0;
-  for (i = 0; i < hash_map->capacity; i++)
+  for (i = 0; i < src->capacity; i++)
     {
-      if (hash_map->buckets[i] != NULL)
+      vector *bucket = src->buckets[i];
+      j = 0;
+      while (bucket != NULL && j < bucket->size)
         {
-          if (hash_map->buckets[i]->size == 0)
+          pair *first = (pair *) bucket->data[j];
+          size_t count = group_end(bucket, j, first->key) - j;
+          size_t hash = hashmap_hash(dst, first->key);
+          size_t index = hash & (dst->capacity - 1);
+          vector *target = dst->buckets[index];
+          int ind = find_in_bucket(target, hash, first->key);
+          size_t dst_count = 0;
+          size_t replaced_bytes = 0;
+          if (ind != -1)
             {
-              vector_free(&hash_map->buckets[i]);
-              break;
+              dst_count = group_end(target, (size_t) ind, first->key)
+                          - (size_t) ind;
+              replaced_bytes = group_bytes(&target->data[ind], dst_count);
             }
-          for (j = 0; j < hash_map->buckets[i]->size; j++)
+          size_t moved_bytes = group_cost(dst, &bucket->data[j], count);
+          size_t extra = 0;
+          if (moved_bytes > replaced_bytes)
+            {
+              extra = moved_bytes - replaced_bytes;
+            }
+          // a move needs room in the bucket and its net growth charged,
+          // both settled before conflict_fn may choose it
+          int movable = ind == -1 || conflict_fn != NULL;
+          size_t room = count > dst_count ? count - dst_count : 0;
+          if (movable && (bucket_make_room(dst, index, room) == 0
+                          || map_charge(dst, extra) == 0))
+            {
+              // keep the pairs not moved yet in src
+              memmove(&bucket->data[0], &bucket->data[j],
+                      (bucket->size - j) * sizeof(void *));
+              memset(&bucket->data[bucket->size - j], 0, j * sizeof(void *));
+              bucket->size -= j;
+              return 0;
+            }
+          target = dst->buckets[index];
+          int replace = ind != -1 && conflict_fn != NULL
+                        && conflict_fn((pair *) target->data[ind], first) == 1;
+          if (ind == -1 || replace)
+            {
+              if (replace)
+                {
+                  bucket_remove_group(target, (size_t) ind, dst_count);
+                  dst->size -= dst_count;
+                  // extra covered what the moved pairs add on top
+                  map_release(dst, replaced_bytes + extra - moved_bytes);
+                }
+              map_release(src, group_bytes(&bucket->data[j], count));
+              bucket_append_group(dst, index, &bucket->data[j], count, hash);
+            }
+          else
             {
-              size_t index = hash_map->hash_func(get_key(hash_map, i, j))
-                  & (new_hash->capacity - 1);
-              if (new_hash->buckets[index] == NULL)
+              if (movable)
+                {
+                  map_release(dst, extra);
+                }
+              if (conflict_fn != NULL)
                 {
-                  new_hash->buckets[index] =
-                      vector_alloc(pair_copy, pair_cmp, pair_free);
-                  if (new_hash->buckets[index] == NULL)
-                    {
-                      hashmap_free(&new_hash);
-                      free(new_hash_2->buckets);
-                      free(new_hash_2);
-                      return 0;
-                    }
+                  // conflict_fn may have updated dst's value
+                  pair_recharge(dst, target->data[ind]);
                 }
-              int check = vector_push_back(new_hash->buckets[index],
-                                           hash_map->buckets[i]->data[j]);
-              if (check == 0)
+              map_release(src, group_bytes(&bucket->data[j], count));
+              size_t k = 0;
+              for (k = j; k < j + count; k++)
                 {
-                  hashmap_free(&new_hash);
-                  free(new_hash_2->buckets);
-                  free(new_hash_2);
-                  return 0;
+                  bucket->elem_free_func(&bucket->data[k]);
                 }
             }
+          memset(&bucket->data[j], 0, count * sizeof(void *));
+          src->size -= count;
+          j += count;
+        }
+      if (bucket != NULL)
+        {
+          bucket->size = 0;
         }
     }
-  new_hash_2->capacity = hash_map->capacity;
-  free(new_hash_2->buckets);
-  new_hash_2->buckets = hash_map->buckets;
-  hashmap_free(&new_hash_2);
-  hash_map->buckets = new_hash->buckets;
-  hash_map->capacity = new_hash->capacity;
-  free(new_hash);
+  table_reset(src);
   return 1;
 }
-//* This function returns the load factor of the vector.
-//* @param vector a vector.
-//* @param add - increase aor decrease the load factor in advanced
-//* @return the vector's load factor, -1 if the function failed.
-//*/
-double pre_hashmap_get_load_factor(const hashmap *hash_map, int add)
+
+// Hands the keyT_func of hashmap_erase_if to hashmap_erase_where.
+typedef struct key_func_ctx {
+    keyT_func func;
+} key_func_ctx;
+
+int key_func_pred (const_keyT key, void *ctx)
 {
-  if (hash_map == NULL)
+  return ((key_func_ctx *) ctx)->func(key);
+}
+
+/**
+ * Erases every pair whose key satisfies keyT_func, in one pass over the
+ * buckets, then shrinks the bucket array at most once.
+ * @param hash_map a hash map.
+ * @param keyT_func a function that returns 1 for the keys to erase.
+ * @return the number of pairs erased, -1 if the function failed.
+ */
+int hashmap_erase_if (hashmap *hash_map, keyT_func keyT_func)
+{
+  if (hash_map == NULL || keyT_func == NULL)
     {
       return -1;
     }
-  double cap = hash_map->capacity;
-  double size = hash_map->size;
-  double load = ((size + add) / cap);
-  return load;
+  key_func_ctx ctx = {keyT_func};
+  return hashmap_erase_where(hash_map, key_func_pred, &ctx);
 }
+
 /**
- * Inserts a new in_pair to the hash map.
- * The function inserts *new*, *copied*, *dynamically allocated* in_pair,
- * NOT the in_pair it receives as a parameter.
- * @param hash_map the hash map to be inserted with new element.
- * @param in_pair a in_pair the hash map would contain.
- * @return returns 1 for successful insertion, 0 otherwise.
+ * Like hashmap_erase_if, with a context handed to the predicate.
+ * @param hash_map a hash map.
+ * @param pred a function that returns 1 for the keys to erase.
+ * @param ctx passed to pred as is.
+ * @return the number of pairs erased, -1 if the function failed.
  */
-int hashmap_insert (hashmap *hash_map, const pair *in_pair)
+int hashmap_erase_where (hashmap *hash_map, hashmap_key_pred pred, void *ctx)
 {
-  if (hash_map == NULL || in_pair == NULL || in_pair->key == NULL ||
-  in_pair->value == NULL || hashmap_at(hash_map, in_pair->key) != NULL)
+  if (hash_map == NULL || pred == NULL)
     {
-      return 0;
+      return -1;
     }
-  if (pre_hashmap_get_load_factor(hash_map, 1) > HASH_MAP_MAX_LOAD_FACTOR)
+  size_t i = 0;
+  size_t j = 0;
+  int counter = 0;
+  for (i = 0; i < hash_map->capacity; i++)
     {
-      hash_map->buckets = realloc(hash_map->buckets, sizeof(void*) *
-      (hash_map->capacity * HASH_MAP_GROWTH_FACTOR));
-      if (hash_map->buckets == NULL)
-        {
-          return 0;
-        }
-      null_it(hash_map, hash_map->capacity);
-      if (hash_update(hash_map, 1) == 0)
+      vector *bucket = hash_map->buckets[i];
+      size_t kept = 0;
+      for (j = 0; bucket != NULL && j < bucket->size; j++)
         {
-          hash_map->buckets = realloc(hash_map->buckets, sizeof(void*) *
-          (hash_map->capacity / HASH_MAP_GROWTH_FACTOR));
-          if (hash_map->buckets == NULL)
+          pair *a = (pair *) bucket->data[j];
+          if (pred(a->key, ctx) == 1)
             {
-              return 0;
+              map_release(hash_map, charged_bytes(a));
+              bucket->elem_free_func(&bucket->data[j]);
+              counter++;
+            }
+          else
+            {
+              // kept pairs keep their order, sorted chains stay sorted
+              bucket->data[kept] = a;
+              kept++;
             }
-          return 0;
         }
-    }
-  size_t index = hash_map->hash_func(in_pair->key) & (hash_map->capacity - 1);
-  if (hash_map->buckets[index] == NULL || ((hash_map->buckets[index] != NULL)
-  && (hash_map->buckets[index]->data[0] == NULL)
-  && (hash_map->buckets[index]->size > 0)))
-    {
-      hash_map->buckets[index] = vector_alloc(pair_copy, pair_cmp, pair_free);
-      if (hash_map->buckets[index] == NULL)
+      if (bucket != NULL)
         {
-          return 0;
+          memset(&bucket->data[kept], 0,
+                 (bucket->size - kept) * sizeof(void *));
+          bucket->size = kept;
         }
     }
-  int check = vector_push_back(hash_map->buckets[index], in_pair);
-  if (check == 0)
+  hash_map->size -= (size_t) counter;
+  shrink_to_fit(hash_map);
+  return counter;
+}
+
+/**
+ * Inserts a copy of in_pair even if its key is already in the map (the map
+ * is then a multimap). The pairs of one key form a contiguous group in its
+ * bucket, in insertion order; hashmap_at and hashmap_erase reach the first
+ * pair of the group.
+ * @param hash_map the hash map to be inserted with new element.
+ * @param in_pair a pair the hash map would contain a copy of.
+ * @return returns 1 for successful insertion, 0 otherwise.
+ */
+int hashmap_multi_insert (hashmap *hash_map, const pair *in_pair)
+{
+  if (hash_map == NULL || in_pair == NULL || in_pair->key == NULL
+      || in_pair->value == NULL)
     {
       return 0;
     }
-  hash_map->size++;
-  return 1;
+  return insert_copy(hash_map, in_pair, hashmap_hash(hash_map, in_pair->key),
+                     1);
 }
 
 /**
- * The function returns the value associated with the given key.
+ * Returns the group of pairs of a key, in one probe, without copying.
  * @param hash_map a hash map.
  * @param key the key to be checked.
- * @return the value associated with key if exists, NULL otherwise
- * (the value itself,
- * not a copy of it).
+ * @param count set to the number of pairs of key, 0 if it is not there.
+ * @return the pairs of key (count consecutive pairs), valid until the map
+ * is next changed. NULL if key is not in the map.
  */
-valueT hashmap_at (const hashmap *hash_map, const_keyT key)
+pair *const *hashmap_multi_range (const hashmap *hash_map, const_keyT key,
+                                  size_t *count)
 {
-  if (hash_map == NULL || key == NULL)
+  if (count != NULL)
+    {
+      *count = 0;
+    }
+  if (hash_map == NULL || key == NULL || count == NULL)
     {
       return NULL;
     }
-  size_t i = 0;
-  size_t j = 0;
-  size_t counter = 0;
-  for (i = 0; i < hash_map->capacity; i++)
+  size_t hash = hashmap_hash(hash_map, key);
+  vector *bucket = hash_map->buckets[hash & (hash_map->capacity - 1)];
+  int first = find_in_bucket(bucket, hash, key);
+  if (first == -1)
     {
-      if (hash_map->buckets[i] != NULL && hash_map->buckets[i]->size > 0)
-        {
-          for (j = 0; j < hash_map->buckets[i]->size; j++)
-            {
-              if (hash_map->buckets[i]->data[j] != NULL)
-                {
-                  keyT new_key = get_key(hash_map, i, j);
-                  pair *a = (pair *) (hash_map->buckets[i]->data[j]);
-                  if (a->key_cmp(new_key, key) == 1)
-                    {
-                      return a->value;
-                    }
-                }
-            }
-          counter += hash_map->buckets[i]->size;
-          if (counter == hash_map->size)
-            {
-              return NULL;
-            }
-        }
+      return NULL;
     }
-  return NULL;
+  *count = group_end(bucket, (size_t) first, key) - (size_t) first;
+  return (pair *const *) &bucket->data[first];
 }
 
 /**
- * The function erases the pair associated with key.
  * @param hash_map a hash map.
- * @param key a key of the pair to be erased.
+ * @param key the key to be checked.
+ * @return the number of pairs of key in the map.
+ */
+size_t hashmap_multi_count (const hashmap *hash_map, const_keyT key)
+{
+  size_t count = 0;
+  hashmap_multi_range(hash_map, key, &count);
+  return count;
+}
+
+/**
+ * Erases the first pair of key whose value equals value (by the pair's
+ * value_cmp).
+ * @param hash_map a hash map.
+ * @param key the key of the pair to be erased.
+ * @param value the value of the pair to be erased.
  * @return 1 if the erasing was done successfully, 0 otherwise.
- * (if key not in map,
- * considered fail).
  */
-int hashmap_erase (hashmap *hash_map, const_keyT key)
+int hashmap_multi_erase (hashmap *hash_map, const_keyT key,
+                         const_valueT value)
 {
-  if (hash_map == NULL || key == NULL || hashmap_at(hash_map, key) == NULL)
+  if (hash_map == NULL || key == NULL || value == NULL)
     {
       return 0;
     }
-  size_t i = 0;
-  size_t j = 0;
-  if (pre_hashmap_get_load_factor(hash_map, -1) < VECTOR_MIN_LOAD_FACTOR)
+  size_t hash = hashmap_hash(hash_map, key);
+  vector *bucket = hash_map->buckets[hash & (hash_map->capacity - 1)];
+  int first = find_in_bucket(bucket, hash, key);
+  if (first == -1)
     {
-      if (hash_update(hash_map, -1) == 0)
-        {
-          return 0;
-        }
+      return 0;
     }
-  for (i = 0; i < hash_map->capacity; i++)
+  size_t end = group_end(bucket, (size_t) first, key);
+  size_t j = 0;
+  for (j = (size_t) first; j < end; j++)
     {
-      if (hash_map->buckets[i] != NULL && hash_map->buckets[i]->size > 0)
+      pair *a = (pair *) bucket->data[j];
+      if (a->value_cmp(a->value, value) == 1)
         {
-          for (j = 0; j < hash_map->buckets[i]->size; j++)
-            {
-              if (hash_map->buckets[i]->data[j] != NULL)
-                {
-                  pair *a = (pair *) (hash_map->buckets[i]->data[j]);
-                  int compare = a->key_cmp(key, a->key);
-                  if (compare == 1)
-                    {
-                      int check = vector_erase(hash_map->buckets[i], j);
-                      if (hash_map->buckets[i]->size == 0)
-                        {
-                          vector_free(&hash_map->buckets[i]);
-                        }
-                      if (check == 0)
-                        {
-                          return 0;
-                        }
-                      hash_map->size--;
-                      return 1;
-                    }
-                }
-            }
+          // like hashmap_erase, never shrinks
+          bucket_remove(hash_map, bucket, j);
+          hash_map->size--;
+          return 1;
         }
     }
   return 0;
 }
 
+/**
+ * Erases all the pairs of key, then shrinks the bucket array at most once.
+ * @param hash_map a hash map.
+ * @param key the key of the pairs to be erased.
+ * @return the number of pairs erased.
+ */
+size_t hashmap_multi_erase_all (hashmap *hash_map, const_keyT key)
+{
+  if (hash_map == NULL || key == NULL)
+    {
+      return 0;
+    }
+  size_t hash = hashmap_hash(hash_map, key);
+  vector *bucket = hash_map->buckets[hash & (hash_map->capacity - 1)];
+  int first = find_in_bucket(bucket, hash, key);
+  if (first == -1)
+    {
+      return 0;
+    }
+  size_t count = group_end(bucket, (size_t) first, key) - (size_t) first;
+  map_release(hash_map,
+              bucket_remove_group(bucket, (size_t) first, count));
+  hash_map->size -= count;
+  shrink_to_fit(hash_map);
+  return count;
+}
+
 /**
  * This function returns the load factor of the hash map.
  * @param hash_map a hash map.
@@ -357,7 +1985,8 @@ double hashmap_get_load_factor (const hashmap *hash_map)
  * @param hash_map a hashmap
  * @param keyT_func a function that checks a condition on keyT and return
  * 1 if true, 0 else
- * @param valT_func a function that modifies valueT, in-place
+ * @param valT_func a function that modifies valueT, in-place. A value that
+ * grows beyond what the account's budget leaves keeps its old charge.
  * @return number of changed values
  */
 int hashmap_apply_if (const hashmap *hash_map, keyT_func keyT_func,
@@ -381,6 +2010,7 @@ int hashmap_apply_if (const hashmap *hash_map, keyT_func keyT_func,
                 {
                   counter ++;
                   valT_func(a->value);
+                  pair_recharge(hash_map, a);
                 }
             }
         }
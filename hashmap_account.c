@@ -0,0 +1,152 @@
+#include "hashmap_account.h"
+
+/**
+ * Initializes an empty account.
+ * @param account the account.
+ * @param budget the maximal number of bytes, 0 for no limit.
+ * @param key_size reports the bytes of a key copy, NULL counts none.
+ * @param value_size reports the bytes of a value copy, NULL counts none.
+ * @return 1 if succeeded, 0 otherwise.
+ */
+int hashmap_account_init (hashmap_account *account, size_t budget,
+                          account_size_func key_size,
+                          account_size_func value_size)
+{
+  if (account == NULL || pthread_mutex_init(&account->lock, NULL) != 0)
+    {
+      return 0;
+    }
+  account->bytes = 0;
+  account->peak = 0;
+  account->budget = budget;
+  account->key_size = key_size;
+  account->value_size = value_size;
+  account->evict = NULL;
+  account->evict_ctx = NULL;
+  return 1;
+}
+
+/**
+ * Releases what hashmap_account_init set up.
+ * @param account the account.
+ */
+void hashmap_account_destroy (hashmap_account *account)
+{
+  if (account != NULL)
+    {
+      pthread_mutex_destroy(&account->lock);
+    }
+}
+
+/**
+ * Sets the function hashmap_insert calls when a pair does not fit in the
+ * budget.
+ * @param account the account.
+ * @param evict the function, NULL to fail inserts right away.
+ * @param ctx passed to evict.
+ */
+void hashmap_account_set_evict (hashmap_account *account,
+                                account_evict_func evict, void *ctx)
+{
+  if (account == NULL)
+    {
+      return;
+    }
+  account->evict = evict;
+  account->evict_ctx = ctx;
+}
+
+/**
+ * @param account the account.
+ * @return the number of bytes charged to the account, 0 if account is NULL.
+ */
+size_t hashmap_account_bytes (hashmap_account *account)
+{
+  if (account == NULL)
+    {
+      return 0;
+    }
+  pthread_mutex_lock(&account->lock);
+  size_t bytes = account->bytes;
+  pthread_mutex_unlock(&account->lock);
+  return bytes;
+}
+
+int account_charge (hashmap_account *account, size_t bytes)
+{
+  if (account == NULL || bytes == 0)
+    {
+      return 1;
+    }
+  pthread_mutex_lock(&account->lock);
+  int check = account->budget == 0
+              || account->bytes + bytes <= account->budget;
+  if (check)
+    {
+      account->bytes += bytes;
+      if (account->bytes > account->peak)
+        {
+          account->peak = account->bytes;
+        }
+    }
+  pthread_mutex_unlock(&account->lock);
+  return check;
+}
+
+void account_release (hashmap_account *account, size_t bytes)
+{
+  if (account == NULL || bytes == 0)
+    {
+      return;
+    }
+  pthread_mutex_lock(&account->lock);
+  account->bytes -= bytes;
+  pthread_mutex_unlock(&account->lock);
+}
+
+int account_make_room (hashmap_account *account, size_t bytes)
+{
+  if (account == NULL || account->budget == 0)
+    {
+      return 1;
+    }
+  // evict erases from the maps, which releases under the lock
+  size_t used = hashmap_account_bytes(account);
+  while (used + bytes > account->budget)
+    {
+      size_t before = used;
+      if (account->evict == NULL
+          || account->evict(account->evict_ctx,
+                            used + bytes - account->budget) == 0)
+        {
+          return 0;
+        }
+      used = hashmap_account_bytes(account);
+      if (used >= before)
+        {
+          return 0;
+        }
+    }
+  return 1;
+}
+
+size_t account_pair_bytes (const hashmap_account *account,
+                           const pair *in_pair)
+{
+  // hashmap.c allocates every pair with the hash of its key and the bytes
+  // it is charged
+  size_t bytes = sizeof(pair) + 2 * sizeof(size_t);
+  if (account == NULL)
+    {
+      return bytes;
+    }
+  if (account->key_size != NULL)
+    {
+      bytes += account->key_size(in_pair->key);
+    }
+  if (account->value_size != NULL)
+    {
+      bytes += account->value_size(in_pair->value);
+    }
+  return bytes;
+}
@@ -0,0 +1,100 @@
+#ifndef HASHMAP_ACCOUNT_H_
+#define HASHMAP_ACCOUNT_H_
+
+#include <pthread.h>
+#include <stdlib.h>
+#include "pair.h"
+
+/**
+ * Returns the number of bytes a key or value copy holds (what the pair's
+ * copy function allocated for it).
+ */
+typedef size_t (*account_size_func) (const void *elem);
+
+/**
+ * Frees memory of a hashmap over its budget, e.g. by erasing pairs.
+ * @param ctx the context given with the function.
+ * @param needed the number of bytes missing.
+ * @return 1 if it freed anything, 0 if it cannot.
+ */
+typedef int (*account_evict_func) (void *ctx, size_t needed);
+
+/**
+ * The memory of the hashmaps charged to it, in bytes: every allocation
+ * hashmap.c makes for them (the map itself, its bucket arrays, vectors and
+ * their slot arrays, scratch space while rehashing) plus sizeof(pair), the
+ * cached hash and the key and value bytes key_size and value_size report
+ * for every pair held.
+ * A map is charged to an account with hashmap_set_account. An account may
+ * hold maps used from several threads, its counters are only read and
+ * written under its lock. With a budget, an allocation that would exceed
+ * it fails, so the operation fails cleanly, and hashmap_insert first asks
+ * evict (if set) to make room. cow_hashmap's own tables are not accounted.
+ */
+typedef struct hashmap_account {
+    size_t bytes;
+    size_t peak;
+    size_t budget;
+    account_size_func key_size;
+    account_size_func value_size;
+    account_evict_func evict;
+    void *evict_ctx;
+    pthread_mutex_t lock;
+} hashmap_account;
+
+/**
+ * Initializes an empty account.
+ * @param account the account.
+ * @param budget the maximal number of bytes, 0 for no limit.
+ * @param key_size reports the bytes of a key copy, NULL counts none.
+ * @param value_size reports the bytes of a value copy, NULL counts none.
+ * @return 1 if succeeded, 0 otherwise.
+ */
+int hashmap_account_init (hashmap_account *account, size_t budget,
+                          account_size_func key_size,
+                          account_size_func value_size);
+
+/**
+ * Releases what hashmap_account_init set up. No map may be charged to the
+ * account any more.
+ * @param account the account.
+ */
+void hashmap_account_destroy (hashmap_account *account);
+
+/**
+ * Sets the function hashmap_insert calls when a pair does not fit in the
+ * budget. It is called again as long as it frees memory and there is still
+ * not enough. It is called without the account's lock held.
+ * @param account the account.
+ * @param evict the function, NULL to fail inserts right away.
+ * @param ctx passed to evict.
+ */
+void hashmap_account_set_evict (hashmap_account *account,
+                                account_evict_func evict, void *ctx);
+
+/**
+ * @param account the account.
+ * @return the number of bytes charged to the account, 0 if account is NULL.
+ */
+size_t hashmap_account_bytes (hashmap_account *account);
+
+/*
+ * The functions below are the allocation layer of hashmap.c. They take the
+ * account of the map at hand, NULL for none.
+ */
+
+// Charges bytes. returns 0 if they would exceed the budget, 1 otherwise.
+int account_charge (hashmap_account *account, size_t bytes);
+
+// Credits bytes back.
+void account_release (hashmap_account *account, size_t bytes);
+
+// Calls the evict function until bytes more fit in the budget.
+// returns 0 if they do not, 1 otherwise.
+int account_make_room (hashmap_account *account, size_t bytes);
+
+// Returns the bytes a pair held by a hashmap is charged.
+size_t account_pair_bytes (const hashmap_account *account,
+                           const pair *in_pair);
+
+#endif // HASHMAP_ACCOUNT_H_
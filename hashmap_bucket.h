@@ -0,0 +1,45 @@
+#ifndef HASHMAP_BUCKET_H_
+#define HASHMAP_BUCKET_H_
+
+#include "hashmap.h"
+
+/*
+ * The bucket layout of hashmap, for the maps that keep their buckets the
+ * same way (cow_hashmap), implemented in hashmap.c. A bucket is a vector
+ * of pairs allocated by hashed_pair_copy, each carrying the full hash of
+ * its key. Chains longer than HASH_MAP_SORTED_CHAIN_LEN pairs are kept
+ * sorted by that hash.
+ */
+
+/**
+ * Copies a pair for a bucket.
+ * @param in_pair the pair to copy.
+ * @param hash the full hash of its key.
+ * @return the copy, freed by pair_free.
+ * @if_fail return NULL.
+ */
+pair *hashed_pair_copy (const pair *in_pair, size_t hash);
+
+/**
+ * @param bucket a bucket.
+ * @param ind a position in the bucket.
+ * @return the full hash of the key at ind.
+ */
+size_t get_hash (const vector *bucket, size_t ind);
+
+/**
+ * Keeps a bucket sorted after a pair was stored at its back (and its size
+ * increased).
+ * @param bucket a bucket.
+ */
+void sort_chain (vector *bucket);
+
+/**
+ * @param bucket a bucket, may be NULL.
+ * @param hash the full hash of key.
+ * @param key the key to be checked.
+ * @return the position of key in the bucket, -1 if it is not there.
+ */
+int find_in_bucket (const vector *bucket, size_t hash, const_keyT key);
+
+#endif // HASHMAP_BUCKET_H_
@@ -0,0 +1,279 @@
+#ifndef HASHMAP_EXT_H_
+#define HASHMAP_EXT_H_
+
+#include <stdint.h>
+#include "hashmap.h"
+#include "bucket_alloc.h"
+#include "hashmap_account.h"
+
+/*
+ * Operations on hashmap beyond the hashmap.h interface, implemented in
+ * hashmap.c.
+ */
+
+// Tables with fewer buckets than this are always rehashed serially.
+#define HASH_MAP_PARALLEL_MIN_CAP (1UL << 16)
+#define HASH_MAP_MAX_REHASH_THREADS 64
+
+/**
+ * A hash func keyed by a map's own seed, see hashmap_alloc_seeded.
+ * @param key the key to hash.
+ * @param seed the two words of the map's 128 bit key.
+ * @return the full hash of the key.
+ */
+typedef size_t (*seeded_hash_func) (const_keyT key, const uint64_t *seed);
+
+/**
+ * Decides a key both maps of hashmap_merge hold. For a multimap key it is
+ * called once, with the first pair of each group, and decides for the
+ * whole groups.
+ * @param dst_pair the pair of the receiving map, may be updated in place.
+ * @param src_pair the pair of the map merged in.
+ * @return 1 for src_pair to replace dst_pair, 0 to keep dst_pair.
+ */
+typedef int (*hashmap_conflict_func) (pair *dst_pair, const pair *src_pair);
+
+/**
+ * Allocates a hash map whose keys are hashed by func under a random key of
+ * its own (see hash_seed_random), e.g. hash_int_seeded over SipHash-1-3.
+ * Keys coming from the outside then cannot be picked to collide, and a
+ * seed learnt from one map tells nothing about another. The map's
+ * hash_func field is NULL, hashmap_hash hashes its keys.
+ * @param func a seeded hash func.
+ * @return pointer to dynamically allocated hashmap.
+ * @if_fail return NULL.
+ */
+hashmap *hashmap_alloc_seeded (seeded_hash_func func);
+
+/**
+ * Replaces the seed of an empty map allocated by hashmap_alloc_seeded,
+ * e.g. to reproduce a layout.
+ * @param hash_map a hash map.
+ * @param k0 the first word of the key.
+ * @param k1 the second word of the key.
+ * @return 1 if succeeded, 0 otherwise (also if the map is not seeded or
+ * not empty).
+ */
+int hashmap_set_seed (hashmap *hash_map, uint64_t k0, uint64_t k1);
+
+/**
+ * Returns the full hash of a key in a hash map, by its hash_func or under
+ * its seed.
+ * @param hash_map a hash map.
+ * @param key the key to hash.
+ * @return the hash.
+ */
+size_t hashmap_hash (const hashmap *hash_map, const_keyT key);
+
+/**
+ * Releases the memory erasing keeps around for reuse: shrinks the bucket
+ * array, in one rehash, while the load factor is under the minimal one
+ * (down to HASH_MAP_INITIAL_CAP buckets), frees the vectors of empty
+ * buckets and trims the slot arrays of the others. hashmap_erase and
+ * hashmap_multi_erase never shrink the map themselves.
+ * @param hash_map a hash map.
+ * @return 1 if succeeded, 0 otherwise (the map stays valid).
+ */
+int hashmap_compact (hashmap *hash_map);
+
+/**
+ * Returns the pair the hash map holds for the given key, e.g. to reach the
+ * map's own copy of the key.
+ * @param hash_map a hash map.
+ * @param key the key to be checked.
+ * @return the pair if exists (the pair itself, not a copy of it), NULL
+ * otherwise.
+ */
+pair *hashmap_find (const hashmap *hash_map, const_keyT key);
+
+/**
+ * Returns the pair the hash map holds for the given key, whose full hash
+ * (see hashmap_hash) the caller already has, e.g. from hashing the key for
+ * a filter in front of the map.
+ * @param hash_map a hash map.
+ * @param key the key to be checked.
+ * @param hash the full hash of key.
+ * @return the pair if exists (the pair itself, not a copy of it), NULL
+ * otherwise.
+ */
+pair *hashmap_find_hashed (const hashmap *hash_map, const_keyT key,
+                           size_t hash);
+
+/**
+ * Replaces the value of the pair of key by a copy of value, charging the
+ * difference in size to the map's account. For a multimap key, the first
+ * pair of its group is updated.
+ * @param hash_map a hash map.
+ * @param key the key of the pair.
+ * @param value the new value.
+ * @return 1 if succeeded, 0 otherwise (also if key is not in the map or
+ * the new value does not fit in the account's budget, the old value then
+ * stays).
+ */
+int hashmap_set_value (hashmap *hash_map, const_keyT key, const_valueT value);
+
+/**
+ * Sets the bucket_alloc policy of a hash map, e.g. to keep a shard's
+ * buckets on the NUMA node of the thread serving it. It covers the bucket
+ * arrays and the vectors and slot arrays of the buckets: the first policy
+ * other than BUCKET_ALLOC_DEFAULT moves the buckets into a pool of chunks
+ * mapped under it, and memory allocated later follows the policy set last.
+ * With BUCKET_ALLOC_NUMA_BIND the current array and chunks are also
+ * migrated to the node if they are mmap backed.
+ * @param hash_map a hash map.
+ * @param policy the policy, copied.
+ * @return 1 if succeeded, 0 otherwise (the map keeps its previous policy).
+ */
+int hashmap_set_bucket_policy (hashmap *hash_map, const bucket_policy *policy);
+
+/**
+ * Charges a hash map to an account from now on (see hashmap_account). Its
+ * pairs are walked once, as accounts may count keys and values
+ * differently, and the bytes it holds move from its previous account to
+ * the new one.
+ * @param hash_map a hash map.
+ * @param account the account, NULL to stop accounting the map.
+ * @return 1 if succeeded, 0 otherwise (also if the map does not fit in the
+ * account's budget, it then stays with its previous account).
+ */
+int hashmap_set_account (hashmap *hash_map, hashmap_account *account);
+
+/**
+ * @param hash_map a hash map.
+ * @return the bytes the map holds, counted as by its account (without one,
+ * keys and values count nothing), 0 if hash_map is NULL.
+ */
+size_t hashmap_memory (const hashmap *hash_map);
+
+/**
+ * Sets the number of threads rehashing the map's tables of at least
+ * HASH_MAP_PARALLEL_MIN_CAP buckets. A rehash splits the old buckets into
+ * residue classes modulo the smaller capacity: with power of two
+ * capacities, old bucket i only feeds new buckets i + k * old capacity
+ * (or, shrinking, i modulo the new capacity), so the classes are rehashed
+ * independently and without locks.
+ * @param hash_map a hash map.
+ * @param threads the number of threads, 1 (the default) rehashes serially,
+ * capped at HASH_MAP_MAX_REHASH_THREADS.
+ * @return 1 if succeeded, 0 otherwise.
+ */
+int hashmap_set_rehash_threads (hashmap *hash_map, size_t threads);
+
+/**
+ * Grows the bucket array, in one rehash, so that count pairs fit under the
+ * maximal load factor without any further rehash.
+ * @param hash_map a hash map.
+ * @param count the number of pairs the map should be able to hold.
+ * @return 1 if succeeded (also if no growth was needed), 0 otherwise (the
+ * map stays as it was).
+ */
+int hashmap_reserve (hashmap *hash_map, size_t count);
+
+/**
+ * Inserts copies of many pairs, growing the bucket array once up front
+ * (see hashmap_reserve) instead of rehashing along the way.
+ * @param hash_map the hash map to be inserted with new elements.
+ * @param pairs the pairs to insert.
+ * @param count the number of pairs.
+ * @return the number of pairs inserted (pairs whose key is already in the
+ * map are skipped, as by hashmap_insert).
+ */
+size_t hashmap_insert_all (hashmap *hash_map, pair *const *pairs,
+                           size_t count);
+
+/**
+ * Moves every pair of src into dst. The pairs themselves are moved, not
+ * copied. dst is grown once up front, so merging never rehashes pair by
+ * pair. Multimaps are merged key by key: the group of pairs of a key moves
+ * whole, and a conflict keeps one of the two groups whole.
+ * @param dst the hash map receiving the pairs.
+ * @param src the hash map giving them away, left empty with
+ * HASH_MAP_INITIAL_CAP buckets if the merge succeeded.
+ * @param conflict_fn called when a key of src is already in dst, decides
+ * which pairs stay; the others are freed. NULL keeps dst's.
+ * @return 1 if succeeded, 0 otherwise (every pair is then still in either
+ * dst or src).
+ */
+int hashmap_merge (hashmap *dst, hashmap *src,
+                   hashmap_conflict_func conflict_fn);
+
+/**
+ * Erases every pair whose key satisfies keyT_func, in one pass over the
+ * buckets, then shrinks the bucket array at most once.
+ * @param hash_map a hash map.
+ * @param keyT_func a function that returns 1 for the keys to erase.
+ * @return the number of pairs erased, -1 if the function failed.
+ */
+int hashmap_erase_if (hashmap *hash_map, keyT_func keyT_func);
+
+/**
+ * Decides whether hashmap_erase_where erases the pair of a key.
+ * @param key the key.
+ * @param ctx the context given with the function.
+ * @return 1 to erase the pair, 0 to keep it.
+ */
+typedef int (*hashmap_key_pred) (const_keyT key, void *ctx);
+
+/**
+ * Like hashmap_erase_if, with a context handed to the predicate.
+ * @param hash_map a hash map.
+ * @param pred a function that returns 1 for the keys to erase.
+ * @param ctx passed to pred as is.
+ * @return the number of pairs erased, -1 if the function failed.
+ */
+int hashmap_erase_where (hashmap *hash_map, hashmap_key_pred pred, void *ctx);
+
+/*
+ * Multimap mode: hashmap_multi_insert lets a key hold several pairs. They
+ * form a contiguous group inside the key's bucket, in insertion order, so
+ * every function below resolves a key with a single bucket probe.
+ * hashmap_at, hashmap_find and hashmap_erase reach the first pair of a
+ * group, hashmap_insert still refuses a key already there.
+ */
+
+/**
+ * Inserts a copy of in_pair even if its key is already in the map.
+ * @param hash_map the hash map to be inserted with new element.
+ * @param in_pair a pair the hash map would contain a copy of.
+ * @return returns 1 for successful insertion, 0 otherwise.
+ */
+int hashmap_multi_insert (hashmap *hash_map, const pair *in_pair);
+
+/**
+ * Returns the group of pairs of a key, without copying.
+ * @param hash_map a hash map.
+ * @param key the key to be checked.
+ * @param count set to the number of pairs of key, 0 if it is not there.
+ * @return the pairs of key (count consecutive pairs), valid until the map
+ * is next changed. NULL if key is not in the map.
+ */
+pair *const *hashmap_multi_range (const hashmap *hash_map, const_keyT key,
+                                  size_t *count);
+
+/**
+ * @param hash_map a hash map.
+ * @param key the key to be checked.
+ * @return the number of pairs of key in the map.
+ */
+size_t hashmap_multi_count (const hashmap *hash_map, const_keyT key);
+
+/**
+ * Erases the first pair of key whose value equals value (by the pair's
+ * value_cmp).
+ * @param hash_map a hash map.
+ * @param key the key of the pair to be erased.
+ * @param value the value of the pair to be erased.
+ * @return 1 if the erasing was done successfully, 0 otherwise.
+ */
+int hashmap_multi_erase (hashmap *hash_map, const_keyT key,
+                         const_valueT value);
+
+/**
+ * Erases all the pairs of key, then shrinks the bucket array at most once.
+ * @param hash_map a hash map.
+ * @param key the key of the pairs to be erased.
+ * @return the number of pairs erased.
+ */
+size_t hashmap_multi_erase_all (hashmap *hash_map, const_keyT key);
+
+#endif // HASHMAP_EXT_H_
@@ -0,0 +1,222 @@
+#include <string.h>
+#include "hashset.h"
+#include "hashmap_ext.h"
+
+// The value of every pair of a set. It is never allocated, copied or freed.
+static char hashset_present = 1;
+
+void *hashset_value_cpy (const_valueT value)
+{
+  (void) value;
+  return &hashset_present;
+}
+
+int hashset_value_cmp (const_valueT value_1, const_valueT value_2)
+{
+  return value_1 == value_2;
+}
+
+void hashset_value_free (valueT *value)
+{
+  *value = NULL;
+}
+
+/**
+ * Allocates dynamically new hash set.
+ * @param func a function which "hashes" elements.
+ * @param elem_cpy returns a dynamically allocated copy of an element.
+ * @param elem_cmp returns 1 if two elements are equal, 0 otherwise.
+ * @param elem_free frees an element copy.
+ * @return pointer to dynamically allocated hashset.
+ * @if_fail return NULL.
+ */
+hashset *hashset_alloc (hash_func func, hashset_elem_cpy elem_cpy,
+                        hashset_elem_cmp elem_cmp, hashset_elem_free elem_free)
+{
+  if (func == NULL || elem_cpy == NULL || elem_cmp == NULL
+      || elem_free == NULL)
+    {
+      return NULL;
+    }
+  hashset *set = calloc(sizeof(*set), 1);
+  if (set == NULL)
+    {
+      return NULL;
+    }
+  set->map = hashmap_alloc(func);
+  if (set->map == NULL)
+    {
+      free(set);
+      return NULL;
+    }
+  set->elem_cpy = elem_cpy;
+  set->elem_cmp = elem_cmp;
+  set->elem_free = elem_free;
+  return set;
+}
+
+/**
+ * Frees a hash set and its elements.
+ * @param p_set pointer to dynamically allocated pointer to hashset.
+ */
+void hashset_free (hashset **p_set)
+{
+  if (p_set == NULL || *p_set == NULL)
+    {
+      return;
+    }
+  hashmap_free(&(*p_set)->map);
+  free(*p_set);
+  *p_set = NULL;
+}
+
+/**
+ * Inserts a copy of elem.
+ * @param set the hash set.
+ * @param elem the element.
+ * @return returns 1 for successful insertion, 0 otherwise.
+ */
+int hashset_insert (hashset *set, const_keyT elem)
+{
+  if (set == NULL || elem == NULL)
+    {
+      return 0;
+    }
+  pair in_pair;
+  in_pair.key = (keyT) elem;
+  in_pair.value = &hashset_present;
+  in_pair.key_cpy = set->elem_cpy;
+  in_pair.key_cmp = set->elem_cmp;
+  in_pair.key_free = set->elem_free;
+  in_pair.value_cpy = hashset_value_cpy;
+  in_pair.value_cmp = hashset_value_cmp;
+  in_pair.value_free = hashset_value_free;
+  return hashmap_insert(set->map, &in_pair);
+}
+
+/**
+ * @param set a hash set.
+ * @param elem the element to be checked.
+ * @return 1 if elem is in the set, 0 otherwise.
+ */
+int hashset_contains (const hashset *set, const_keyT elem)
+{
+  if (set == NULL)
+    {
+      return 0;
+    }
+  return hashmap_find(set->map, elem) != NULL;
+}
+
+/**
+ * Erases elem from the set.
+ * @param set a hash set.
+ * @param elem the element to be erased.
+ * @return 1 if the erasing was done successfully, 0 otherwise.
+ */
+int hashset_erase (hashset *set, const_keyT elem)
+{
+  if (set == NULL)
+    {
+      return 0;
+    }
+  return hashmap_erase(set->map, elem);
+}
+
+/**
+ * @param set a hash set.
+ * @return the number of elements, 0 if set is NULL.
+ */
+size_t hashset_size (const hashset *set)
+{
+  if (set == NULL)
+    {
+      return 0;
+    }
+  return set->map->size;
+}
+
+/**
+ * Adds to dst a copy of every element of src it does not hold yet.
+ * @return 1 if succeeded, 0 otherwise (dst may hold part of src).
+ */
+int hashset_union (hashset *dst, const hashset *src)
+{
+  if (dst == NULL || src == NULL)
+    {
+      return 0;
+    }
+  if (dst == src)
+    {
+      return 1;
+    }
+  // grown once up front, as if the sets were disjoint
+  if (hashmap_reserve(dst->map, dst->map->size + src->map->size) == 0)
+    {
+      return 0;
+    }
+  size_t i = 0;
+  size_t j = 0;
+  for (i = 0; i < src->map->capacity; i++)
+    {
+      vector *bucket = src->map->buckets[i];
+      for (j = 0; bucket != NULL && j < bucket->size; j++)
+        {
+          keyT elem = ((pair *) bucket->data[j])->key;
+          // a new element is probed once; only a refused insertion asks
+          // whether elem was there already or the insertion failed
+          if (!hashset_insert(dst, elem) && !hashset_contains(dst, elem))
+            {
+              return 0;
+            }
+        }
+    }
+  return 1;
+}
+
+// The other set of hashset_retain and the presence in it it keeps.
+typedef struct retain_ctx {
+    const hashset *other;
+    int keep_present;
+    int same;
+} retain_ctx;
+
+// Tells whether hashset_retain drops an element.
+int retain_drops (const_keyT elem, void *ctx)
+{
+  retain_ctx *retain = ctx;
+  int present = retain->same || hashset_contains(retain->other, elem);
+  return present != retain->keep_present;
+}
+
+// Erases from dst, in one pass over its buckets, every element whose
+// presence in other differs from keep_present, then shrinks the table once.
+int hashset_retain (hashset *dst, const hashset *other, int keep_present)
+{
+  if (dst == NULL || other == NULL)
+    {
+      return 0;
+    }
+  retain_ctx ctx = {other, keep_present, dst == other};
+  hashmap_erase_where(dst->map, retain_drops, &ctx);
+  hashmap_compact(dst->map);
+  return 1;
+}
+
+/**
+ * Erases from dst every element that is not in other.
+ * @return 1 if succeeded, 0 on invalid arguments.
+ */
+int hashset_intersect (hashset *dst, const hashset *other)
+{
+  return hashset_retain(dst, other, 1);
+}
+
+/**
+ * Erases from dst every element that is in other.
+ * @return 1 if succeeded, 0 on invalid arguments.
+ */
+int hashset_difference (hashset *dst, const hashset *other)
+{
+  return hashset_retain(dst, other, 0);
+}
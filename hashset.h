@@ -0,0 +1,88 @@
+#ifndef HASHSET_H_
+#define HASHSET_H_
+
+#include "hashmap.h"
+
+typedef void *(*hashset_elem_cpy) (const_keyT);
+typedef int (*hashset_elem_cmp) (const_keyT, const_keyT);
+typedef void (*hashset_elem_free) (keyT *);
+
+/**
+ * A set of keys on top of hashmap. Every element is stored as a pair whose
+ * value is a shared static marker, so there is no value allocation and no
+ * value callbacks for the user to supply.
+ */
+typedef struct hashset {
+    hashmap *map;
+    hashset_elem_cpy elem_cpy;
+    hashset_elem_cmp elem_cmp;
+    hashset_elem_free elem_free;
+} hashset;
+
+/**
+ * Allocates dynamically new hash set.
+ * @param func a function which "hashes" elements.
+ * @param elem_cpy returns a dynamically allocated copy of an element.
+ * @param elem_cmp returns 1 if two elements are equal, 0 otherwise.
+ * @param elem_free frees an element copy.
+ * @return pointer to dynamically allocated hashset.
+ * @if_fail return NULL.
+ */
+hashset *hashset_alloc (hash_func func, hashset_elem_cpy elem_cpy,
+                        hashset_elem_cmp elem_cmp, hashset_elem_free elem_free);
+
+/**
+ * Frees a hash set and its elements.
+ * @param p_set pointer to dynamically allocated pointer to hashset.
+ */
+void hashset_free (hashset **p_set);
+
+/**
+ * Inserts a copy of elem.
+ * @param set the hash set.
+ * @param elem the element.
+ * @return returns 1 for successful insertion, 0 otherwise (elem already in
+ * set included).
+ */
+int hashset_insert (hashset *set, const_keyT elem);
+
+/**
+ * @param set a hash set.
+ * @param elem the element to be checked.
+ * @return 1 if elem is in the set, 0 otherwise.
+ */
+int hashset_contains (const hashset *set, const_keyT elem);
+
+/**
+ * Erases elem from the set.
+ * @param set a hash set.
+ * @param elem the element to be erased.
+ * @return 1 if the erasing was done successfully, 0 otherwise.
+ */
+int hashset_erase (hashset *set, const_keyT elem);
+
+/**
+ * @param set a hash set.
+ * @return the number of elements, 0 if set is NULL.
+ */
+size_t hashset_size (const hashset *set);
+
+/**
+ * Adds to dst a copy of every element of src it does not hold yet.
+ * @return 1 if succeeded, 0 otherwise (dst may hold part of src).
+ */
+int hashset_union (hashset *dst, const hashset *src);
+
+/**
+ * Erases from dst every element that is not in other.
+ * @return 1 if succeeded, 0 on invalid arguments.
+ */
+int hashset_intersect (hashset *dst, const hashset *other);
+
+/**
+ * Erases from dst every element that is in other.
+ * @return 1 if succeeded, 0 on invalid arguments.
+ */
+int hashset_difference (hashset *dst, const hashset *other);
+
+#endif // HASHSET_H_
@@ -0,0 +1,598 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "logged_hashmap.h"
+#include "hashmap_ext.h"
+
+// checksum (4 bytes), operation (1 byte), sequence number (8 bytes)
+#define LOG_RECORD_PREFIX 13UL
+#define LOG_SNAPSHOT_SUFFIX ".snap"
+#define LOG_SNAPSHOT_TMP_SUFFIX ".snap.tmp"
+
+// Returns the length of a record of the given operation.
+size_t log_record_len (const logged_hashmap *map, int op)
+{
+  if (op == HASHMAP_LOG_ERASE)
+    {
+      return LOG_RECORD_PREFIX + map->key_size;
+    }
+  return LOG_RECORD_PREFIX + map->key_size + map->value_size;
+}
+
+// FNV-1a over the record after its checksum.
+uint32_t log_checksum (const unsigned char *record, size_t len)
+{
+  uint32_t hash = 2166136261UL;
+  size_t i = 0;
+  for (i = 4; i < len; i++)
+    {
+      hash = (hash ^ record[i]) * 16777619UL;
+    }
+  return hash;
+}
+
+// Returns a copy of path with suffix appended, NULL if failed.
+char *log_path_with (const char *path, const char *suffix)
+{
+  size_t len = strlen(path);
+  char *joined = malloc(len + strlen(suffix) + 1);
+  if (joined == NULL)
+    {
+      return NULL;
+    }
+  memcpy(joined, path, len);
+  strcpy(joined + len, suffix);
+  return joined;
+}
+
+// Syncs the directory holding path, so a rename in it is durable.
+// returns 0 if failed, 1 if succeeded
+int log_sync_dir (const char *path)
+{
+  char *dir = log_path_with(path, "");
+  if (dir == NULL)
+    {
+      return 0;
+    }
+  char *slash = strrchr(dir, '/');
+  if (slash == dir)
+    {
+      slash[1] = '\0';
+    }
+  else if (slash != NULL)
+    {
+      *slash = '\0';
+    }
+  int fd = open(slash == NULL ? "." : dir, O_RDONLY);
+  free(dir);
+  if (fd == -1)
+    {
+      return 0;
+    }
+  // some file systems cannot sync a directory, their renames are durable
+  int check = fsync(fd) == 0 || errno == EINVAL;
+  close(fd);
+  return check;
+}
+
+// Applies one record to a map.
+// returns 0 if failed, 1 if succeeded
+int log_apply (hashmap *hash_map, const pair *functions, int op,
+               const_keyT key, const_valueT value)
+{
+  if (op == HASHMAP_LOG_INSERT)
+    {
+      pair in_pair = *functions;
+      in_pair.key = (keyT) key;
+      in_pair.value = (valueT) value;
+      return hashmap_insert(hash_map, &in_pair);
+    }
+  if (op == HASHMAP_LOG_UPDATE)
+    {
+      return hashmap_set_value(hash_map, key, value);
+    }
+  if (op == HASHMAP_LOG_ERASE)
+    {
+      return hashmap_erase(hash_map, key);
+    }
+  return 0;
+}
+
+// Reads the header of a log, 0 if there is none (an empty or cut file).
+// base is set to the last change before the log, held by the snapshot.
+// returns 0 if none, 1 if read, -1 if the file is no log of this version
+int log_read_header (FILE *in, size_t *key_size, size_t *value_size,
+                     uint64_t *base)
+{
+  uint64_t header[5];
+  if (fread(header, sizeof(header), 1, in) != 1)
+    {
+      return 0;
+    }
+  if (header[0] != HASHMAP_LOG_MAGIC || header[1] != HASHMAP_LOG_VERSION
+      || header[2] == 0)
+    {
+      return -1;
+    }
+  *key_size = header[2];
+  *value_size = header[3];
+  *base = header[4];
+  return 1;
+}
+
+// Writes the header of a log restarting after the changes the snapshot
+// holds (all but the buffered ones), fsyncing it if sync is set.
+// returns 0 if failed, 1 if succeeded
+int log_write_header (const logged_hashmap *map)
+{
+  uint64_t header[] = {HASHMAP_LOG_MAGIC, HASHMAP_LOG_VERSION, map->key_size,
+                       map->value_size, map->sequence - map->records};
+  return write(map->fd, header, sizeof(header)) == sizeof(header)
+         && (!map->sync || fsync(map->fd) == 0);
+}
+
+// Applies the records after the header with a sequence number above
+// *sequence, up to the first one cut short or corrupted. Sets *sequence to
+// the last one applied and *valid to the bytes of the log up to there.
+// returns 0 if a record could not be applied, 1 otherwise
+int log_read (FILE *in, const logged_hashmap *shape, hashmap *hash_map,
+              uint64_t *sequence, long *valid)
+{
+  size_t max_len = log_record_len(shape, HASHMAP_LOG_INSERT);
+  unsigned char *record = malloc(max_len);
+  void *key = malloc(shape->key_size);
+  void *value = malloc(shape->value_size + 1);
+  int check = record != NULL && key != NULL && value != NULL;
+  *valid = ftell(in);
+  while (check && fread(record, LOG_RECORD_PREFIX, 1, in) == 1)
+    {
+      int op = record[4];
+      if (op < HASHMAP_LOG_INSERT || op > HASHMAP_LOG_ERASE)
+        {
+          break;
+        }
+      size_t len = log_record_len(shape, op);
+      uint32_t checksum = 0;
+      uint64_t record_sequence = 0;
+      memcpy(&checksum, record, sizeof(checksum));
+      memcpy(&record_sequence, record + 5, sizeof(record_sequence));
+      if (fread(record + LOG_RECORD_PREFIX, len - LOG_RECORD_PREFIX, 1, in)
+          != 1 || log_checksum(record, len) != checksum)
+        {
+          break;
+        }
+      // copied out for alignment
+      memcpy(key, record + LOG_RECORD_PREFIX, shape->key_size);
+      memcpy(value, record + LOG_RECORD_PREFIX + shape->key_size,
+             len - LOG_RECORD_PREFIX - shape->key_size);
+      if (record_sequence > *sequence)
+        {
+          check = log_apply(hash_map, &shape->functions, op, key, value);
+          *sequence = record_sequence;
+        }
+      *valid = ftell(in);
+    }
+  free(record);
+  free(key);
+  free(value);
+  return check;
+}
+
+// Reads a snapshot into a map: a header (magic, version, key and value
+// size, the last change it holds, the number of pairs) then the key and
+// value bytes of every pair. The sizes of shape, if set, must match, else
+// they are set from the header. Sets *sequence to the last change held.
+// returns 0 if failed, 1 if succeeded
+int snapshot_read (FILE *in, logged_hashmap *shape, hashmap *hash_map,
+                   uint64_t *sequence)
+{
+  uint64_t header[6];
+  if (fread(header, sizeof(header), 1, in) != 1
+      || header[0] != HASHMAP_SNAPSHOT_MAGIC
+      || header[1] != HASHMAP_LOG_VERSION || header[2] == 0
+      || (shape->key_size != 0 && (header[2] != shape->key_size
+                                   || header[3] != shape->value_size)))
+    {
+      return 0;
+    }
+  shape->key_size = header[2];
+  shape->value_size = header[3];
+  void *key = malloc(shape->key_size);
+  void *value = malloc(shape->value_size + 1);
+  int check = key != NULL && value != NULL;
+  uint64_t i = 0;
+  for (i = 0; check && i < header[5]; i++)
+    {
+      check = fread(key, shape->key_size, 1, in) == 1
+              && (shape->value_size == 0
+                  || fread(value, shape->value_size, 1, in) == 1)
+              && log_apply(hash_map, &shape->functions, HASHMAP_LOG_INSERT,
+                           key, value);
+    }
+  free(key);
+  free(value);
+  if (check)
+    {
+      *sequence = header[4];
+    }
+  return check;
+}
+
+// Writes the snapshot of a map to a temporary file, syncs it and renames
+// it over the previous one, so a snapshot is always whole.
+// returns 0 if failed, 1 if succeeded
+int snapshot_write (const logged_hashmap *map)
+{
+  char *snapshot = log_path_with(map->path, LOG_SNAPSHOT_SUFFIX);
+  char *tmp = log_path_with(map->path, LOG_SNAPSHOT_TMP_SUFFIX);
+  FILE *out = NULL;
+  if (snapshot != NULL && tmp != NULL)
+    {
+      out = fopen(tmp, "wb");
+    }
+  uint64_t header[] = {HASHMAP_SNAPSHOT_MAGIC, HASHMAP_LOG_VERSION,
+                       map->key_size, map->value_size, map->sequence,
+                       map->map->size};
+  int check = out != NULL && fwrite(header, sizeof(header), 1, out) == 1;
+  size_t i = 0;
+  size_t j = 0;
+  for (i = 0; check && i < map->map->capacity; i++)
+    {
+      vector *bucket = map->map->buckets[i];
+      for (j = 0; check && bucket != NULL && j < bucket->size; j++)
+        {
+          pair *in_pair = bucket->data[j];
+          check = fwrite(in_pair->key, map->key_size, 1, out) == 1
+                  && (map->value_size == 0
+                      || fwrite(in_pair->value, map->value_size, 1, out)
+                         == 1);
+        }
+    }
+  if (out != NULL)
+    {
+      check = check && fflush(out) == 0 && fsync(fileno(out)) == 0;
+      check = fclose(out) == 0 && check;
+    }
+  check = check && rename(tmp, snapshot) == 0 && log_sync_dir(map->path);
+  if (!check && tmp != NULL)
+    {
+      remove(tmp);
+    }
+  free(snapshot);
+  free(tmp);
+  return check;
+}
+
+/**
+ * Opens a log, rebuilding the map it describes from its snapshot and the
+ * records after it, and appends to it from now on. A missing log is
+ * created empty.
+ * @return pointer to dynamically allocated logged hashmap.
+ * @if_fail return NULL.
+ */
+logged_hashmap *logged_hashmap_open (const char *path, hash_func func,
+                                     const pair *functions, size_t key_size,
+                                     size_t value_size, size_t group,
+                                     int sync)
+{
+  if (path == NULL || functions == NULL || key_size == 0 || group == 0)
+    {
+      return NULL;
+    }
+  logged_hashmap *map = calloc(sizeof(*map), 1);
+  if (map == NULL)
+    {
+      return NULL;
+    }
+  map->fd = -1;
+  map->functions = *functions;
+  map->key_size = key_size;
+  map->value_size = value_size;
+  map->group = group;
+  map->sync = sync;
+  map->map = hashmap_alloc(func);
+  map->buffer = malloc(group * log_record_len(map, HASHMAP_LOG_INSERT));
+  map->path = log_path_with(path, "");
+  char *snapshot = log_path_with(path, LOG_SNAPSHOT_SUFFIX);
+  int check = map->map != NULL && map->buffer != NULL && map->path != NULL
+              && snapshot != NULL;
+  long valid = 0;
+  FILE *in = NULL;
+  if (check)
+    {
+      in = fopen(snapshot, "rb");
+    }
+  if (in != NULL)
+    {
+      check = snapshot_read(in, map, map->map, &map->sequence);
+      fclose(in);
+    }
+  free(snapshot);
+  in = NULL;
+  if (check)
+    {
+      in = fopen(path, "rb");
+    }
+  if (in != NULL)
+    {
+      size_t log_key_size = 0;
+      size_t log_value_size = 0;
+      uint64_t base = 0;
+      int header = log_read_header(in, &log_key_size, &log_value_size,
+                                   &base);
+      // a log restarting after changes the snapshot lacks cannot be used
+      check = header == 0 || (header == 1 && log_key_size == key_size
+                              && log_value_size == value_size
+                              && base <= map->sequence);
+      if (check && header == 1)
+        {
+          check = log_read(in, map, map->map, &map->sequence, &valid);
+        }
+      fclose(in);
+    }
+  if (check)
+    {
+      map->fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+      // cut off a record (or header) a crash left half written
+      check = map->fd != -1 && ftruncate(map->fd, valid) == 0;
+    }
+  if (check && valid == 0)
+    {
+      check = log_write_header(map);
+    }
+  if (!check)
+    {
+      logged_hashmap_close(&map);
+    }
+  return map;
+}
+
+/**
+ * Commits the buffered records and frees the map and the log handle.
+ * @param p_map pointer to dynamically allocated pointer to logged_hashmap.
+ * @return 1 if the last records were committed, 0 otherwise.
+ */
+int logged_hashmap_close (logged_hashmap **p_map)
+{
+  if (p_map == NULL || *p_map == NULL)
+    {
+      return 0;
+    }
+  logged_hashmap *map = *p_map;
+  int check = map->fd != -1 && logged_hashmap_commit(map);
+  if (map->fd != -1)
+    {
+      close(map->fd);
+    }
+  if (map->map != NULL)
+    {
+      hashmap_free(&map->map);
+    }
+  free(map->buffer);
+  free(map->path);
+  free(map);
+  *p_map = NULL;
+  return check;
+}
+
+/**
+ * Writes the buffered records to the log (and fsyncs it if sync is set).
+ * @return 1 if succeeded, 0 otherwise (the records stay buffered).
+ */
+int logged_hashmap_commit (logged_hashmap *map)
+{
+  if (map == NULL)
+    {
+      return 0;
+    }
+  if (map->used == 0)
+    {
+      return 1;
+    }
+  struct stat st;
+  if (fstat(map->fd, &st) != 0)
+    {
+      return 0;
+    }
+  // a checkpoint that could not write the new header left the log empty
+  if (st.st_size == 0 && log_write_header(map) == 0)
+    {
+      return 0;
+    }
+  size_t written = 0;
+  while (written < map->used)
+    {
+      ssize_t n = write(map->fd, map->buffer + written, map->used - written);
+      if (n < 0 && errno == EINTR)
+        {
+          continue;
+        }
+      if (n <= 0)
+        {
+          // no half group may stay in front of the next one
+          (void) ftruncate(map->fd, st.st_size);
+          return 0;
+        }
+      written += (size_t) n;
+    }
+  map->used = 0;
+  map->records = 0;
+  return !map->sync || fsync(map->fd) == 0;
+}
+
+// Writes the record of the change about to be made behind the buffered
+// ones, committing them first if the group is full. It is only kept
+// (log_keep) once the change succeeded.
+// returns 0 if failed, 1 if succeeded
+int log_append (logged_hashmap *map, int op, const_keyT key,
+                const_valueT value)
+{
+  if (map->records == map->group && logged_hashmap_commit(map) == 0)
+    {
+      return 0;
+    }
+  unsigned char *record = map->buffer + map->used;
+  size_t len = log_record_len(map, op);
+  uint64_t sequence = map->sequence + 1;
+  record[4] = (unsigned char) op;
+  memcpy(record + 5, &sequence, sizeof(sequence));
+  memcpy(record + LOG_RECORD_PREFIX, key, map->key_size);
+  if (op != HASHMAP_LOG_ERASE)
+    {
+      memcpy(record + LOG_RECORD_PREFIX + map->key_size, value,
+             map->value_size);
+    }
+  uint32_t checksum = log_checksum(record, len);
+  memcpy(record, &checksum, sizeof(checksum));
+  return 1;
+}
+
+// Keeps the record log_append buffered, committing a full group.
+void log_keep (logged_hashmap *map, int op)
+{
+  map->used += log_record_len(map, op);
+  map->records++;
+  map->sequence++;
+  if (map->records == map->group)
+    {
+      // a failed commit is retried before the next record
+      logged_hashmap_commit(map);
+    }
+}
+
+/**
+ * Inserts a copy of in_pair (see hashmap_insert) and logs it.
+ * @return returns 1 for successful insertion, 0 otherwise.
+ */
+int logged_hashmap_insert (logged_hashmap *map, const pair *in_pair)
+{
+  if (map == NULL || in_pair == NULL || in_pair->key == NULL
+      || in_pair->value == NULL
+      || log_append(map, HASHMAP_LOG_INSERT, in_pair->key,
+                    in_pair->value) == 0
+      || hashmap_insert(map->map, in_pair) == 0)
+    {
+      return 0;
+    }
+  log_keep(map, HASHMAP_LOG_INSERT);
+  return 1;
+}
+
+/**
+ * Replaces the value of key by a copy of value and logs it.
+ * @return 1 if succeeded, 0 otherwise (also if key is not in the map).
+ */
+int logged_hashmap_update (logged_hashmap *map, const_keyT key,
+                           const_valueT value)
+{
+  if (map == NULL || key == NULL || value == NULL)
+    {
+      return 0;
+    }
+  if (hashmap_find(map->map, key) == NULL
+      || log_append(map, HASHMAP_LOG_UPDATE, key, value) == 0
+      || hashmap_set_value(map->map, key, value) == 0)
+    {
+      return 0;
+    }
+  log_keep(map, HASHMAP_LOG_UPDATE);
+  return 1;
+}
+
+/**
+ * Erases the pair of key (see hashmap_erase) and logs it.
+ * @return 1 if the erasing was done successfully, 0 otherwise.
+ */
+int logged_hashmap_erase (logged_hashmap *map, const_keyT key)
+{
+  if (map == NULL || key == NULL
+      || log_append(map, HASHMAP_LOG_ERASE, key, NULL) == 0
+      || hashmap_erase(map->map, key) == 0)
+    {
+      return 0;
+    }
+  log_keep(map, HASHMAP_LOG_ERASE);
+  return 1;
+}
+
+/**
+ * Writes a snapshot of the map, then restarts the log after it.
+ * @return 1 if succeeded, 0 otherwise.
+ */
+int logged_hashmap_checkpoint (logged_hashmap *map)
+{
+  if (map == NULL || logged_hashmap_commit(map) == 0
+      || snapshot_write(map) == 0)
+    {
+      return 0;
+    }
+  // a crash before the new header leaves an empty log, which opens as one,
+  // and a failed header write is retried by the next commit
+  return ftruncate(map->fd, 0) == 0 && log_write_header(map);
+}
+
+/**
+ * Loads the snapshot of a log into an empty map.
+ * @return 1 if succeeded, 0 otherwise.
+ */
+int hashmap_snapshot_load (hashmap *hash_map, const char *path,
+                           const pair *functions, uint64_t *sequence)
+{
+  if (hash_map == NULL || path == NULL || functions == NULL
+      || sequence == NULL)
+    {
+      return 0;
+    }
+  char *snapshot = log_path_with(path, LOG_SNAPSHOT_SUFFIX);
+  FILE *in = NULL;
+  if (snapshot != NULL)
+    {
+      in = fopen(snapshot, "rb");
+    }
+  free(snapshot);
+  if (in == NULL)
+    {
+      return 0;
+    }
+  logged_hashmap shape;
+  memset(&shape, 0, sizeof(shape));
+  shape.functions = *functions;
+  int check = snapshot_read(in, &shape, hash_map, sequence);
+  fclose(in);
+  return check;
+}
+
+/**
+ * Applies the records of a log to a map. Only records after *sequence are
+ * applied.
+ * @return 1 if succeeded, 0 otherwise.
+ */
+int hashmap_log_replay (hashmap *hash_map, const char *path,
+                        const pair *functions, uint64_t *sequence)
+{
+  if (hash_map == NULL || path == NULL || functions == NULL
+      || sequence == NULL)
+    {
+      return 0;
+    }
+  FILE *in = fopen(path, "rb");
+  if (in == NULL)
+    {
+      return 0;
+    }
+  logged_hashmap shape;
+  memset(&shape, 0, sizeof(shape));
+  shape.functions = *functions;
+  uint64_t base = 0;
+  int check = log_read_header(in, &shape.key_size, &shape.value_size,
+                              &base) == 1
+              && base <= *sequence;
+  long valid = 0;
+  check = check && log_read(in, &shape, hash_map, sequence, &valid);
+  fclose(in);
+  return check;
+}
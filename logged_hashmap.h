@@ -0,0 +1,136 @@
+#ifndef LOGGED_HASHMAP_H_
+#define LOGGED_HASHMAP_H_
+
+#include <stdint.h>
+#include "hashmap.h"
+
+#define HASHMAP_LOG_MAGIC 0x474C4D48UL
+#define HASHMAP_SNAPSHOT_MAGIC 0x534C4D48UL
+#define HASHMAP_LOG_VERSION 2UL
+#define HASHMAP_LOG_INSERT 1
+#define HASHMAP_LOG_UPDATE 2
+#define HASHMAP_LOG_ERASE 3
+
+/**
+ * A hashmap whose changes are appended to a log file: a header (magic,
+ * version, key and value size, the last change before the log) then one
+ * record per insert, value update or erase: a checksum, the operation, a
+ * sequence number, the key bytes and, but for erases, the value bytes.
+ * Keys and values are key_size and value_size bytes long and written
+ * bytewise, the pair functions given on opening rebuild them.
+ * Records are buffered and written group by group (group commit); a change
+ * is durable once logged_hashmap_commit wrote it, with fsync if sync is
+ * set. A record cut short by a crash fails its checksum, replay stops
+ * there and reopening the log cuts it off.
+ * logged_hashmap_checkpoint writes the whole map to a snapshot next to the
+ * log (its path with ".snap" appended) and restarts the log after it, so
+ * the log does not grow without bound and opening replays only its tail.
+ */
+typedef struct logged_hashmap {
+    hashmap *map;
+    pair functions;
+    char *path;
+    int fd;
+    unsigned char *buffer;
+    size_t used;
+    size_t records;
+    size_t group;
+    size_t key_size;
+    size_t value_size;
+    uint64_t sequence;
+    int sync;
+} logged_hashmap;
+
+/**
+ * Opens a log, rebuilding the map it describes from its snapshot, if any,
+ * and the records after it, and appends to it from now on. A missing log
+ * is created empty.
+ * @param path the log file.
+ * @param func a function which "hashes" keys.
+ * @param functions a pair whose copy, compare and free functions the
+ * rebuilt pairs get (its key and value are not used).
+ * @param key_size the size in bytes of every key.
+ * @param value_size the size in bytes of every value.
+ * @param group the number of records written together, at least 1.
+ * @param sync 1 to fsync every group, 0 to leave it to the system.
+ * @return pointer to dynamically allocated logged hashmap.
+ * @if_fail return NULL (also if the log holds other key or value sizes, or
+ * restarts after changes the snapshot does not hold).
+ */
+logged_hashmap *logged_hashmap_open (const char *path, hash_func func,
+                                     const pair *functions, size_t key_size,
+                                     size_t value_size, size_t group,
+                                     int sync);
+
+/**
+ * Commits the buffered records and frees the map and the log handle.
+ * @param p_map pointer to dynamically allocated pointer to logged_hashmap.
+ * @return 1 if the last records were committed, 0 otherwise.
+ */
+int logged_hashmap_close (logged_hashmap **p_map);
+
+/**
+ * Inserts a copy of in_pair (see hashmap_insert) and logs it.
+ * @return returns 1 for successful insertion, 0 otherwise.
+ */
+int logged_hashmap_insert (logged_hashmap *map, const pair *in_pair);
+
+/**
+ * Replaces the value of key by a copy of value and logs it.
+ * @return 1 if succeeded, 0 otherwise (also if key is not in the map).
+ */
+int logged_hashmap_update (logged_hashmap *map, const_keyT key,
+                           const_valueT value);
+
+/**
+ * Erases the pair of key (see hashmap_erase) and logs it.
+ * @return 1 if the erasing was done successfully, 0 otherwise.
+ */
+int logged_hashmap_erase (logged_hashmap *map, const_keyT key);
+
+/**
+ * Writes the buffered records to the log (and fsyncs it if sync is set).
+ * @return 1 if succeeded, 0 otherwise (the records stay buffered).
+ */
+int logged_hashmap_commit (logged_hashmap *map);
+
+/**
+ * Writes the buffered records, then a snapshot of the whole map with the
+ * sequence number of its last change, and truncates the log to a header
+ * restarting after it. The snapshot is written to a temporary file, synced
+ * and renamed over the previous one; a crash at any point leaves a
+ * snapshot and a log that reopen to the same map.
+ * @return 1 if succeeded, 0 otherwise (reopening still rebuilds the map).
+ */
+int logged_hashmap_checkpoint (logged_hashmap *map);
+
+/**
+ * Loads the snapshot of a log into an empty map, e.g. to start a replica
+ * before replaying the log with hashmap_log_replay.
+ * @param hash_map the map.
+ * @param path the log file (not the snapshot itself).
+ * @param functions a pair whose copy, compare and free functions the
+ * inserted pairs get.
+ * @param sequence set to the last change the snapshot holds.
+ * @return 1 if succeeded, 0 otherwise (also if there is no snapshot).
+ */
+int hashmap_snapshot_load (hashmap *hash_map, const char *path,
+                           const pair *functions, uint64_t *sequence);
+
+/**
+ * Applies the records of a log to a map, e.g. to catch a snapshot or a
+ * replica up. Only records after *sequence are applied.
+ * @param hash_map the map.
+ * @param path the log file.
+ * @param functions a pair whose copy, compare and free functions the
+ * inserted pairs get.
+ * @param sequence in: the last change the map already holds, 0 for none.
+ * out: the last change applied.
+ * @return 1 if succeeded, 0 otherwise (the changes up to *sequence are
+ * applied; nothing is if the log restarts after *sequence, a checkpoint
+ * then dropped changes the map lacks, see hashmap_snapshot_load).
+ */
+int hashmap_log_replay (hashmap *hash_map, const char *path,
+                        const pair *functions, uint64_t *sequence);
+
+#endif // LOGGED_HASHMAP_H_
@@ -0,0 +1,202 @@
+#include "sharded_hashmap.h"
+#include "hashmap_ext.h"
+/**
+ * Allocates dynamically new sharded hash map.
+ * @param func a function which "hashes" keys.
+ * @param shard_bits log2 of the number of shards.
+ * @return pointer to dynamically allocated sharded hashmap.
+ * @if_fail return NULL.
+ */
+sharded_hashmap *sharded_hashmap_alloc (hash_func func, size_t shard_bits)
+{
+  return sharded_hashmap_alloc_policy(func, shard_bits, NULL);
+}
+
+/**
+ * Allocates dynamically new sharded hash map whose shards each allocate
+ * their bucket arrays under their own policy.
+ * @param func a function which "hashes" keys.
+ * @param shard_bits log2 of the number of shards.
+ * @param policies one policy per shard, NULL for the default policy.
+ * @return pointer to dynamically allocated sharded hashmap.
+ * @if_fail return NULL.
+ */
+sharded_hashmap *sharded_hashmap_alloc_policy (hash_func func,
+                                               size_t shard_bits,
+                                               const bucket_policy *policies)
+{
+  if (func == NULL || shard_bits > SHARDED_HASHMAP_MAX_SHARD_BITS)
+    {
+      return NULL;
+    }
+  sharded_hashmap *map = calloc(sizeof(*map), 1);
+  if (map == NULL)
+    {
+      return NULL;
+    }
+  map->shard_bits = shard_bits;
+  map->shard_count = ((size_t) 1) << shard_bits;
+  map->hash_func = func;
+  map->shards = calloc(sizeof(hashmap *), map->shard_count);
+  if (map->shards == NULL)
+    {
+      free(map);
+      return NULL;
+    }
+  size_t i = 0;
+  for (i = 0; i < map->shard_count; i++)
+    {
+      map->shards[i] = hashmap_alloc(func);
+      if (map->shards[i] == NULL
+          || (policies != NULL
+              && hashmap_set_bucket_policy(map->shards[i], &policies[i]) == 0))
+        {
+          sharded_hashmap_free(&map);
+          return NULL;
+        }
+    }
+  return map;
+}
+
+/**
+ * Frees a sharded hash map and all of its shards.
+ * @param p_map pointer to dynamically allocated pointer to sharded_hashmap.
+ */
+void sharded_hashmap_free (sharded_hashmap **p_map)
+{
+  if (p_map == NULL || *p_map == NULL)
+    {
+      return;
+    }
+  size_t i = 0;
+  for (i = 0; i < (*p_map)->shard_count; i++)
+    {
+      if ((*p_map)->shards[i] != NULL)
+        {
+          hashmap_free(&((*p_map)->shards[i]));
+        }
+    }
+  free((*p_map)->shards);
+  free(*p_map);
+  *p_map = NULL;
+}
+
+// The shard index is taken from the top bits of the hash after a
+// multiplicative mix, so identity hashes (hash_int, hash_char) still spread
+// over the shards, while each shard keeps indexing its buckets with the low
+// bits of the raw hash.
+size_t sharded_hashmap_shard_of (const sharded_hashmap *map, const_keyT key)
+{
+  if (map->shard_bits == 0)
+    {
+      return 0;
+    }
+  uint64_t mixed = ((uint64_t) map->hash_func(key)) * SHARDED_HASHMAP_MIX;
+  return (size_t) (mixed >> (64 - map->shard_bits));
+}
+
+/**
+ * Returns the shard at the given index.
+ * @param map a sharded hash map.
+ * @param ind the shard index.
+ * @return the shard if exists, NULL otherwise.
+ */
+hashmap *sharded_hashmap_shard (const sharded_hashmap *map, size_t ind)
+{
+  if (map == NULL || ind >= map->shard_count)
+    {
+      return NULL;
+    }
+  return map->shards[ind];
+}
+
+/**
+ * Inserts a copy of in_pair to the shard its key belongs to.
+ * @param map the sharded hash map.
+ * @param in_pair a pair the map would contain.
+ * @return returns 1 for successful insertion, 0 otherwise.
+ */
+int sharded_hashmap_insert (sharded_hashmap *map, const pair *in_pair)
+{
+  if (map == NULL || in_pair == NULL || in_pair->key == NULL)
+    {
+      return 0;
+    }
+  size_t ind = sharded_hashmap_shard_of(map, in_pair->key);
+  return hashmap_insert(map->shards[ind], in_pair);
+}
+
+/**
+ * The function returns the value associated with the given key.
+ * @param map a sharded hash map.
+ * @param key the key to be checked.
+ * @return the value associated with key if exists, NULL otherwise.
+ */
+valueT sharded_hashmap_at (const sharded_hashmap *map, const_keyT key)
+{
+  if (map == NULL || key == NULL)
+    {
+      return NULL;
+    }
+  size_t ind = sharded_hashmap_shard_of(map, key);
+  return hashmap_at(map->shards[ind], key);
+}
+
+/**
+ * The function erases the pair associated with key.
+ * @param map a sharded hash map.
+ * @param key a key of the pair to be erased.
+ * @return 1 if the erasing was done successfully, 0 otherwise.
+ */
+int sharded_hashmap_erase (sharded_hashmap *map, const_keyT key)
+{
+  if (map == NULL || key == NULL)
+    {
+      return 0;
+    }
+  size_t ind = sharded_hashmap_shard_of(map, key);
+  return hashmap_erase(map->shards[ind], key);
+}
+
+/**
+ * Returns the number of pairs stored in all shards.
+ * @param map a sharded hash map.
+ * @return the total size, 0 if map is NULL.
+ */
+size_t sharded_hashmap_size (const sharded_hashmap *map)
+{
+  if (map == NULL)
+    {
+      return 0;
+    }
+  size_t size = 0;
+  size_t i = 0;
+  for (i = 0; i < map->shard_count; i++)
+    {
+      size += map->shards[i]->size;
+    }
+  return size;
+}
+
+/**
+ * Applies hashmap_apply_if on every shard.
+ * @param map a sharded hash map.
+ * @param keyT_func a function that checks a condition on keyT.
+ * @param valT_func a function that modifies valueT, in-place.
+ * @return number of changed values, -1 on invalid arguments.
+ */
+int sharded_hashmap_apply_if (const sharded_hashmap *map, keyT_func keyT_func,
+                              valueT_func valT_func)
+{
+  if (map == NULL || keyT_func == NULL || valT_func == NULL)
+    {
+      return -1;
+    }
+  int counter = 0;
+  size_t i = 0;
+  for (i = 0; i < map->shard_count; i++)
+    {
+      counter += hashmap_apply_if(map->shards[i], keyT_func, valT_func);
+    }
+  return counter;
+}
@@ -0,0 +1,115 @@
+#ifndef SHARDED_HASHMAP_H_
+#define SHARDED_HASHMAP_H_
+
+#include <stdint.h>
+#include "hashmap.h"
+#include "bucket_alloc.h"
+
+#define SHARDED_HASHMAP_MAX_SHARD_BITS 16UL
+#define SHARDED_HASHMAP_MIX 0x9E3779B97F4A7C15ULL
+
+/**
+ * A hash map split into 2^shard_bits independent hashmaps.
+ * Every key is routed to a shard by the top bits of its (mixed) hash, so each
+ * shard grows on its own and a resize only touches 1/2^k of the
+ * table. Shards are also the unit for parallel iteration and locking.
+ */
+typedef struct sharded_hashmap {
+    hashmap **shards;
+    size_t shard_bits;
+    size_t shard_count;
+    hash_func hash_func;
+} sharded_hashmap;
+
+/**
+ * Allocates dynamically new sharded hash map.
+ * @param func a function which "hashes" keys.
+ * @param shard_bits log2 of the number of shards
+ * (at most SHARDED_HASHMAP_MAX_SHARD_BITS).
+ * @return pointer to dynamically allocated sharded hashmap.
+ * @if_fail return NULL.
+ */
+sharded_hashmap *sharded_hashmap_alloc (hash_func func, size_t shard_bits);
+
+/**
+ * Allocates dynamically new sharded hash map whose shards each allocate
+ * their bucket arrays under their own policy (see
+ * hashmap_set_bucket_policy), e.g. every shard bound to the NUMA node of
+ * the thread serving it.
+ * @param func a function which "hashes" keys.
+ * @param shard_bits log2 of the number of shards
+ * (at most SHARDED_HASHMAP_MAX_SHARD_BITS).
+ * @param policies one policy per shard (2^shard_bits of them), copied. NULL
+ * for the default policy everywhere.
+ * @return pointer to dynamically allocated sharded hashmap.
+ * @if_fail return NULL.
+ */
+sharded_hashmap *sharded_hashmap_alloc_policy (hash_func func,
+                                               size_t shard_bits,
+                                               const bucket_policy *policies);
+
+/**
+ * Frees a sharded hash map and all of its shards.
+ * @param p_map pointer to dynamically allocated pointer to sharded_hashmap.
+ */
+void sharded_hashmap_free (sharded_hashmap **p_map);
+
+/**
+ * Returns the index of the shard the given key belongs to.
+ * @param map a sharded hash map.
+ * @param key the key to route.
+ * @return shard index in [0, shard_count - 1].
+ */
+size_t sharded_hashmap_shard_of (const sharded_hashmap *map, const_keyT key);
+
+/**
+ * Returns the shard at the given index (the shard itself, not a copy of it),
+ * e.g. for per-shard iteration from a worker thread.
+ * @param map a sharded hash map.
+ * @param ind the shard index.
+ * @return the shard if exists, NULL otherwise.
+ */
+hashmap *sharded_hashmap_shard (const sharded_hashmap *map, size_t ind);
+
+/**
+ * Inserts a copy of in_pair to the shard its key belongs to.
+ * @param map the sharded hash map.
+ * @param in_pair a pair the map would contain.
+ * @return returns 1 for successful insertion, 0 otherwise.
+ */
+int sharded_hashmap_insert (sharded_hashmap *map, const pair *in_pair);
+
+/**
+ * The function returns the value associated with the given key.
+ * @param map a sharded hash map.
+ * @param key the key to be checked.
+ * @return the value associated with key if exists, NULL otherwise.
+ */
+valueT sharded_hashmap_at (const sharded_hashmap *map, const_keyT key);
+
+/**
+ * The function erases the pair associated with key.
+ * @param map a sharded hash map.
+ * @param key a key of the pair to be erased.
+ * @return 1 if the erasing was done successfully, 0 otherwise.
+ */
+int sharded_hashmap_erase (sharded_hashmap *map, const_keyT key);
+
+/**
+ * Returns the number of pairs stored in all shards.
+ * @param map a sharded hash map.
+ * @return the total size, 0 if map is NULL.
+ */
+size_t sharded_hashmap_size (const sharded_hashmap *map);
+
+/**
+ * Applies hashmap_apply_if on every shard.
+ * @param map a sharded hash map.
+ * @param keyT_func a function that checks a condition on keyT.
+ * @param valT_func a function that modifies valueT, in-place.
+ * @return number of changed values, -1 on invalid arguments.
+ */
+int sharded_hashmap_apply_if (const sharded_hashmap *map, keyT_func keyT_func,
+                              valueT_func valT_func);
+
+#endif // SHARDED_HASHMAP_H_
@@ -0,0 +1,35 @@
+#ifndef SLOT_LAYOUT_H_
+#define SLOT_LAYOUT_H_
+
+#include <stddef.h>
+
+/**
+ * The layout of the fixed size key/value slots of compact_hashmap and
+ * frozen_hashmap: the key at offset 0, then the value, each aligned.
+ */
+
+// Returns the alignment of an object of the given size: the largest power of
+// two dividing it, up to 8.
+static inline size_t slot_align (size_t size)
+{
+  size_t align = 1;
+  while (align < 8 && size % (align * 2) == 0)
+    {
+      align *= 2;
+    }
+  return align;
+}
+
+// Sets the offset of the value in a slot and the stride between slots, so
+// that both the key and the value of every slot are aligned.
+static inline void slot_layout (size_t key_size, size_t value_size,
+                                size_t *value_offset, size_t *stride)
+{
+  size_t key_align = slot_align(key_size);
+  size_t value_align = slot_align(value_size);
+  size_t align = key_align > value_align ? key_align : value_align;
+  *value_offset = (key_size + value_align - 1) & ~(value_align - 1);
+  *stride = (*value_offset + value_size + align - 1) & ~(align - 1);
+}
+
+#endif // SLOT_LAYOUT_H_
@@ -1,6 +1,23 @@
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
 #include "test_suite.h"
 #include "hash_funcs.h"
 #include "test_pairs.h"
+#include "sharded_hashmap.h"
+#include "bucket_alloc.h"
+#include "compact_hashmap.h"
+#include "hashmap_ext.h"
+#include "cache_hashmap.h"
+#include "ttl_hashmap.h"
+#include "hashset.h"
+#include "frozen_hashmap.h"
+#include "filtered_hashmap.h"
+#include "cow_hashmap.h"
+#include "hashmap_account.h"
+#include "logged_hashmap.h"
 
 #define CAPACITY 16
 #define LOW_SIZE 4
@@ -17,7 +34,28 @@
 #define SIZE_4 4
 #define SIZE_3 3
 #define SIZE_9 9
+#define LOG_TEMPLATE "/tmp/hashmap_test_XXXXXX"
+#define SNAPSHOT_SUFFIX ".snap"
 #define VALUES {0, 1, 2, 3, 4, 5, 6}
+#define SHARD_BITS 2
+#define SHARD_COUNT 4
+#define SMALL_BUCKETS 1024
+#define LARGE_BUCKETS (1UL << 19)
+#define COMPACT_SIZE 1000
+#define COMPACT_CAPACITY 2048
+#define FLOOD_SHIFT 10
+#define SIP_KEY_0 0x0706050403020100ULL
+#define SIP_KEY_1 0x0f0e0d0c0b0a0908ULL
+#define SIP_EMPTY 0xabac0158050fc4dcULL
+#define TTL_SHORT 10
+#define TTL_LONG 100000
+#define TTL_LATE_EXPIRED 22
+#define TTL_HUGE (((uint64_t) 1) << 36)
+#define CHAR_COUNT 256
+#define MAX_FP_RATE 0.1
+#define PARALLEL_SIZE 100000
+#define REHASH_THREADS 4
+#define COW_SIZE 1000
 //#define INSERT_TEST "passed insert tests\n"
 //#define ERASE_TEST "passed erase tests\n"
 //#define AT_TEST "passed hash_map_at tests\n"
@@ -196,7 +234,8 @@ void test_hash_map_erase(void)
   assert(hash_map_2->capacity == (size_t) CAPACITY);
   assert(hashmap_erase(hash_map_2, pairs_array_2[SIZE_3]->key) == 1);
   assert(hash_map_2->size == (size_t) SIZE_3);
-  assert(hash_map_2->capacity == (size_t) SIZE_8);
+  // erasing keeps the buckets, hashmap_compact releases them
+  assert(hash_map_2->capacity == (size_t) CAPACITY);
   char char_key = (char) (SIZE_5 + ASCII_A);
   int int_value = SIZE_5;
   new_pair_2 = pair_alloc (&char_key, &int_value, char_key_cpy, int_value_cpy,
@@ -206,7 +245,7 @@ void test_hash_map_erase(void)
   pairs_array_2[LOW_SIZE] = new_pair_2;
   assert(hashmap_insert(hash_map_2, pairs_array_2[SIZE_3]) == 1);
   assert(hash_map_2->size == (size_t) LOW_SIZE);
-  assert(hash_map_2->capacity == (size_t) SIZE_8);
+  assert(hash_map_2->capacity == (size_t) CAPACITY);
 
   for (i = 0; i < SIZE_5; i++)
     {
@@ -283,6 +322,1442 @@ void test_hash_map_apply_if()
   //printf (APPLY_TEST);
 }
 
+/**
+ * This function checks the sharded_hashmap functions of the hashmap library.
+ * If one of them fails at some points, the functions exits with exit code 1.
+ */
+void test_sharded_hash_map(void)
+{
+  assert(sharded_hashmap_alloc (NULL, SHARD_BITS) == NULL);
+  sharded_hashmap *map = sharded_hashmap_alloc (hash_char, SHARD_BITS);
+  assert(map);
+  assert(map->shard_count == (size_t) SHARD_COUNT);
+  pair *pairs_array[MID_SIZE];
+  int i = 0;
+  for (i = 0; i < MID_SIZE; i++)
+    {
+      char char_key = (char) (i + ASCII_A);
+      int int_value = i;
+      pairs_array[i] = pair_alloc (&char_key, &int_value, char_key_cpy,
+                                   int_value_cpy,
+                                   char_key_cmp, int_value_cmp, char_key_free,
+                                   int_value_free);
+      assert(pairs_array[i]);
+      assert(sharded_hashmap_insert (map, pairs_array[i]) == 1);
+    }
+  assert(sharded_hashmap_insert (map, pairs_array[0]) == 0);
+  assert(sharded_hashmap_size (map) == (size_t) MID_SIZE);
+  size_t used_shards = 0;
+  for (i = 0; i < SHARD_COUNT; i++)
+    {
+      used_shards += sharded_hashmap_shard (map, i)->size > 0;
+    }
+  assert(used_shards > 1);
+  assert(sharded_hashmap_shard (map, SHARD_COUNT) == NULL);
+  for (i = 0; i < MID_SIZE; i++)
+    {
+      assert(*(int *) sharded_hashmap_at (map, pairs_array[i]->key) == i);
+    }
+  assert(sharded_hashmap_erase (map, pairs_array[0]->key) == 1);
+  assert(sharded_hashmap_erase (map, pairs_array[0]->key) == 0);
+  assert(sharded_hashmap_at (map, pairs_array[0]->key) == NULL);
+  assert(sharded_hashmap_size (map) == (size_t) MID_SIZE - 1);
+  for (i = 0; i < MID_SIZE; i++)
+    {
+      pair_free ((void **) &pairs_array[i]);
+    }
+  sharded_hashmap_free (&map);
+  assert(map == NULL);
+  bucket_policy policies[SHARD_COUNT];
+  for (i = 0; i < SHARD_COUNT; i++)
+    {
+      policies[i].flags = BUCKET_ALLOC_NUMA_BIND;
+      policies[i].node = 0;
+    }
+  map = sharded_hashmap_alloc_policy (hash_int, SHARD_BITS, policies);
+  assert(map);
+  assert(hashmap_set_bucket_policy (sharded_hashmap_shard (map, 0), NULL)
+         == 0);
+  for (i = 0; i < MID_SIZE; i++)
+    {
+      pairs_array[i] = pair_alloc (&i, &i, int_value_cpy, int_value_cpy,
+                                   int_value_cmp, int_value_cmp,
+                                   int_value_free, int_value_free);
+      assert(pairs_array[i]);
+      assert(sharded_hashmap_insert (map, pairs_array[i]) == 1);
+      pair_free ((void **) &pairs_array[i]);
+    }
+  assert(sharded_hashmap_size (map) == (size_t) MID_SIZE);
+  sharded_hashmap_free (&map);
+}
+
+/**
+ * This function checks the bucket_alloc functions of the hashmap library,
+ * on both sides of BUCKET_ALLOC_MMAP_THRESHOLD.
+ * If one of them fails at some points, the functions exits with exit code 1.
+ */
+void test_bucket_alloc(void)
+{
+  bucket_policy policy = {BUCKET_ALLOC_HUGE_PAGES
+                          | BUCKET_ALLOC_NUMA_INTERLEAVE, 0};
+  assert(bucket_alloc_policy ((size_t) -1, sizeof(size_t), &policy) == NULL);
+  size_t *buckets = bucket_alloc_policy (SMALL_BUCKETS, sizeof(size_t),
+                                         &policy);
+  assert(buckets);
+  size_t i = 0;
+  for (i = 0; i < SMALL_BUCKETS; i++)
+    {
+      assert(buckets[i] == 0);
+      buckets[i] = i;
+    }
+  buckets = bucket_realloc (buckets, SMALL_BUCKETS, LARGE_BUCKETS,
+                            sizeof(size_t));
+  assert(buckets);
+  for (i = 0; i < SMALL_BUCKETS; i++)
+    {
+      assert(buckets[i] == i);
+    }
+  buckets[LARGE_BUCKETS - 1] = LARGE_BUCKETS;
+  assert(bucket_alloc_bind (buckets, SMALL_BUCKETS, sizeof(size_t), 0) == 0);
+  assert(bucket_realloc (buckets, LARGE_BUCKETS, (size_t) -1, sizeof(size_t))
+         == NULL);
+  buckets = bucket_realloc (buckets, LARGE_BUCKETS, SMALL_BUCKETS,
+                            sizeof(size_t));
+  assert(buckets);
+  assert(buckets[SMALL_BUCKETS - 1] == SMALL_BUCKETS - 1);
+  bucket_free (buckets, SMALL_BUCKETS, sizeof(size_t));
+  buckets = bucket_alloc_policy (LARGE_BUCKETS, sizeof(size_t), &policy);
+  assert(buckets && buckets[LARGE_BUCKETS - 1] == 0);
+  bucket_free (buckets, LARGE_BUCKETS, sizeof(size_t));
+}
+
+/**
+ * This function checks the compact_hashmap functions of the hashmap library.
+ * If one of them fails at some points, the functions exits with exit code 1.
+ */
+void test_compact_hash_map(void)
+{
+  assert(compact_hashmap_alloc (NULL, sizeof(int), sizeof(int)) == NULL);
+  compact_hashmap *map = compact_hashmap_alloc (hash_int, sizeof(int),
+                                                sizeof(double));
+  assert(map);
+  int i = 0;
+  for (i = 0; i < COMPACT_SIZE; i++)
+    {
+      double value = i / 2.0;
+      assert(compact_hashmap_insert (map, &i, &value) == 1);
+    }
+  i = 0;
+  assert(compact_hashmap_insert (map, &i, &i) == 0);
+  assert(map->size == (size_t) COMPACT_SIZE);
+  assert(map->capacity == (size_t) COMPACT_CAPACITY);
+  for (i = 0; i < COMPACT_SIZE; i++)
+    {
+      assert(*(double *) compact_hashmap_at (map, &i) == i / 2.0);
+    }
+  for (i = 0; i < COMPACT_SIZE; i += 2)
+    {
+      assert(compact_hashmap_erase (map, &i) == 1);
+      assert(compact_hashmap_erase (map, &i) == 0);
+      assert(compact_hashmap_at (map, &i) == NULL);
+    }
+  for (i = 1; i < COMPACT_SIZE; i += 2)
+    {
+      assert(*(double *) compact_hashmap_at (map, &i) == i / 2.0);
+    }
+  assert(map->size == (size_t) COMPACT_SIZE / 2);
+  for (i = 1; i < COMPACT_SIZE; i += 2)
+    {
+      assert(compact_hashmap_erase (map, &i) == 1);
+    }
+  assert(map->size == 0);
+  assert(map->capacity == (size_t) COMPACT_HASHMAP_INITIAL_CAP);
+  compact_hashmap_free (&map);
+  assert(map == NULL);
+}
+
+/**
+ * A hash whose low bits are all zero, every key falls in bucket 0.
+ */
+size_t hash_char_flood (const void *elem)
+{
+  return hash_char (elem) << FLOOD_SHIFT;
+}
+
+size_t flood_hash_calls = 0;
+
+/**
+ * hash_char_flood, counting its calls in flood_hash_calls.
+ */
+size_t hash_char_counted (const void *elem)
+{
+  flood_hash_calls++;
+  return hash_char_flood (elem);
+}
+
+/**
+ * This function checks that a flooded bucket and the seeded hash funcs
+ * still give correct hashmap_at and hashmap_erase results, that a lookup
+ * in a sorted chain hashes its key only once, and that every seeded map
+ * has a seed of its own.
+ * If one of them fails at some points, the functions exits with exit code 1.
+ */
+void test_hash_map_flooding(void)
+{
+  uint64_t sip_key[2] = {SIP_KEY_0, SIP_KEY_1};
+  assert(siphash13 ("", 0, sip_key) == SIP_EMPTY);
+  // the second map is seeded
+  hash_func funcs[SIZE_3] = {hash_char_flood, NULL, hash_char_counted};
+  int f = 0;
+  for (f = 0; f < SIZE_3; f++)
+    {
+      hashmap *hash_map = f == 1 ? hashmap_alloc_seeded (hash_char_seeded)
+                                 : hashmap_alloc (funcs[f]);
+      assert(hash_map);
+      pair *pairs_array[MID_SIZE];
+      int i = 0;
+      for (i = 0; i < MID_SIZE; i++)
+        {
+          char char_key = (char) (MID_SIZE - i + ASCII_A);
+          int int_value = i;
+          pairs_array[i] = pair_alloc (&char_key, &int_value, char_key_cpy,
+                                       int_value_cpy,
+                                       char_key_cmp, int_value_cmp,
+                                       char_key_free, int_value_free);
+          assert(pairs_array[i]);
+          assert(hashmap_insert (hash_map, pairs_array[i]) == 1);
+          assert(hashmap_insert (hash_map, pairs_array[i]) == 0);
+        }
+      if (f != 1)
+        {
+          assert(hash_map->buckets[0]->size == (size_t) MID_SIZE);
+        }
+      flood_hash_calls = 0;
+      assert(*(int *) hashmap_at (hash_map, pairs_array[0]->key) == 0);
+      assert(f != SIZE_3 - 1 || flood_hash_calls == 1);
+      for (i = 0; i < MID_SIZE; i++)
+        {
+          assert(*(int *) hashmap_at (hash_map, pairs_array[i]->key) == i);
+        }
+      for (i = 0; i < MID_SIZE; i += 2)
+        {
+          assert(hashmap_erase (hash_map, pairs_array[i]->key) == 1);
+          assert(hashmap_at (hash_map, pairs_array[i]->key) == NULL);
+        }
+      for (i = 1; i < MID_SIZE; i += 2)
+        {
+          assert(*(int *) hashmap_at (hash_map, pairs_array[i]->key) == i);
+        }
+      for (i = 0; i < MID_SIZE; i++)
+        {
+          pair_free ((void **) &pairs_array[i]);
+        }
+      hashmap_free (&hash_map);
+    }
+  // every seeded map draws its own seed, which only an empty map replaces
+  hashmap *first = hashmap_alloc_seeded (hash_char_seeded);
+  hashmap *second = hashmap_alloc_seeded (hash_char_seeded);
+  assert(first && second);
+  assert(hashmap_alloc_seeded (NULL) == NULL);
+  assert(first->hash_func == NULL);
+  char char_key = (char) ASCII_A;
+  assert(hashmap_hash (first, &char_key) != hashmap_hash (second, &char_key));
+  assert(hashmap_set_seed (first, SIP_KEY_0, SIP_KEY_1) == 1);
+  assert(hashmap_set_seed (second, SIP_KEY_0, SIP_KEY_1) == 1);
+  assert(hashmap_hash (first, &char_key) == hashmap_hash (second, &char_key));
+  assert(hashmap_hash (first, &char_key)
+         == (size_t) siphash13 (&char_key, sizeof(char), sip_key));
+  int int_value = 0;
+  pair *new_pair = pair_alloc (&char_key, &int_value, char_key_cpy,
+                               int_value_cpy, char_key_cmp, int_value_cmp,
+                               char_key_free, int_value_free);
+  assert(new_pair);
+  assert(hashmap_insert (first, new_pair) == 1);
+  assert(hashmap_set_seed (first, SIP_KEY_1, SIP_KEY_0) == 0);
+  assert(hashmap_freeze (first, sizeof(char), sizeof(int)) == NULL);
+  hashmap *plain = hashmap_alloc (hash_char);
+  assert(plain);
+  assert(hashmap_set_seed (plain, SIP_KEY_0, SIP_KEY_1) == 0);
+  pair_free ((void **) &new_pair);
+  hashmap_free (&plain);
+  hashmap_free (&second);
+  hashmap_free (&first);
+}
+
+/**
+ * This function checks that hashmap_erase keeps emptied buckets for reuse
+ * and that hashmap_compact releases them.
+ * If one of them fails at some points, the functions exits with exit code 1.
+ */
+void test_hash_map_compact(void)
+{
+  assert(hashmap_compact (NULL) == 0);
+  hashmap *hash_map = hashmap_alloc (hash_char);
+  assert(hash_map);
+  pair *pairs_array[MID_SIZE];
+  int i = 0;
+  for (i = 0; i < MID_SIZE; i++)
+    {
+      char char_key = (char) (i + ASCII_A);
+      int int_value = i;
+      pairs_array[i] = pair_alloc (&char_key, &int_value, char_key_cpy,
+                                   int_value_cpy,
+                                   char_key_cmp, int_value_cmp, char_key_free,
+                                   int_value_free);
+      assert(pairs_array[i]);
+      assert(hashmap_insert (hash_map, pairs_array[i]) == 1);
+    }
+  size_t index = hash_char (pairs_array[0]->key) & (hash_map->capacity - 1);
+  vector *bucket = hash_map->buckets[index];
+  assert(hashmap_erase (hash_map, pairs_array[0]->key) == 1);
+  assert(hash_map->buckets[index] == bucket);
+  assert(bucket->size == 0);
+  assert(hashmap_insert (hash_map, pairs_array[0]) == 1);
+  assert(hash_map->buckets[index] == bucket);
+  assert(hashmap_erase (hash_map, pairs_array[0]->key) == 1);
+  assert(hashmap_compact (hash_map) == 1);
+  assert(hash_map->buckets[index] == NULL);
+  assert(hash_map->capacity == (size_t) HIGH_CAPACITY);
+  for (i = 1; i < MID_SIZE; i++)
+    {
+      assert(*(int *) hashmap_at (hash_map, pairs_array[i]->key) == i);
+      assert(hashmap_erase (hash_map, pairs_array[i]->key) == 1);
+    }
+  assert(hash_map->size == 0);
+  assert(hash_map->capacity == (size_t) HIGH_CAPACITY);
+  assert(hashmap_compact (hash_map) == 1);
+  // an empty map keeps its initial buckets
+  assert(hash_map->capacity == HASH_MAP_INITIAL_CAP);
+  for (i = 0; i < MID_SIZE; i++)
+    {
+      assert(hashmap_insert (hash_map, pairs_array[i]) == 1);
+    }
+  for (i = 0; i < MID_SIZE; i++)
+    {
+      assert(*(int *) hashmap_at (hash_map, pairs_array[i]->key) == i);
+      pair_free ((void **) &pairs_array[i]);
+    }
+  hashmap_free (&hash_map);
+}
+
+/**
+ * Counts the pairs evicted from a cache.
+ */
+void count_evicted (const pair *evicted, void *counter)
+{
+  assert(evicted && evicted->key && evicted->value);
+  (*(int *) counter)++;
+}
+
+/**
+ * Looks up every letter key in a cache, from a lookup thread.
+ */
+void *lookup_cached (void *cache)
+{
+  int i = 0;
+  for (i = 0; i < SIZE_8 * HIGH_CAPACITY; i++)
+    {
+      char char_key = (char) (i % SIZE_8 + ASCII_A);
+      cache_hashmap_at (cache, &char_key);
+    }
+  return NULL;
+}
+
+/**
+ * This function checks the cache_hashmap functions of the hashmap library,
+ * and lookups from several threads at once.
+ * If one of them fails at some points, the functions exits with exit code 1.
+ */
+void test_cache_hash_map(void)
+{
+  int evicted = 0;
+  assert(cache_hashmap_alloc (hash_char, 0, NULL, NULL, NULL) == NULL);
+  cache_hashmap *cache = cache_hashmap_alloc (hash_char, LOW_SIZE, NULL,
+                                              count_evicted, &evicted);
+  assert(cache);
+  pair *pairs_array[SIZE_8];
+  int i = 0;
+  for (i = 0; i < SIZE_8; i++)
+    {
+      char char_key = (char) (i + ASCII_A);
+      int int_value = i;
+      pairs_array[i] = pair_alloc (&char_key, &int_value, char_key_cpy,
+                                   int_value_cpy,
+                                   char_key_cmp, int_value_cmp, char_key_free,
+                                   int_value_free);
+      assert(pairs_array[i]);
+    }
+  for (i = 0; i < LOW_SIZE; i++)
+    {
+      assert(cache_hashmap_insert (cache, pairs_array[i]) == 1);
+    }
+  assert(cache_hashmap_insert (cache, pairs_array[0]) == 0);
+  assert(evicted == 0);
+  // hit 0 and 1, the clock should pass over them and evict 2 then 3
+  assert(*(int *) cache_hashmap_at (cache, pairs_array[0]->key) == 0);
+  assert(*(int *) cache_hashmap_at (cache, pairs_array[1]->key) == 1);
+  assert(cache_hashmap_insert (cache, pairs_array[LOW_SIZE]) == 1);
+  assert(evicted == 1);
+  assert(cache_hashmap_at (cache, pairs_array[2]->key) == NULL);
+  assert(cache_hashmap_insert (cache, pairs_array[SIZE_5]) == 1);
+  assert(cache_hashmap_at (cache, pairs_array[SIZE_3]->key) == NULL);
+  assert(*(int *) cache_hashmap_at (cache, pairs_array[0]->key) == 0);
+  assert(*(int *) cache_hashmap_at (cache, pairs_array[1]->key) == 1);
+  assert(cache->map->size == (size_t) LOW_SIZE);
+  assert(cache_hashmap_erase (cache, pairs_array[0]->key) == 1);
+  assert(cache_hashmap_erase (cache, pairs_array[0]->key) == 0);
+  assert(cache->used == (size_t) SIZE_3);
+  assert(evicted == 2);
+  // lookups only set referenced bits, they need no exclusive lock
+  pthread_t threads[SIZE_4];
+  for (i = 0; i < SIZE_4; i++)
+    {
+      assert(pthread_create (&threads[i], NULL, lookup_cached, cache) == 0);
+    }
+  for (i = 0; i < SIZE_4; i++)
+    {
+      pthread_join (threads[i], NULL);
+    }
+  for (i = 0; (size_t) i < cache->clock_size; i++)
+    {
+      assert(cache->clock[i]->referenced == 1);
+    }
+  for (i = 0; i < SIZE_8; i++)
+    {
+      pair_free ((void **) &pairs_array[i]);
+    }
+  cache_hashmap_free (&cache);
+  assert(cache == NULL);
+}
+
+/**
+ * A clock for offline ttl tests, reads the tick counter it is given.
+ */
+uint64_t fake_clock (void *ticks)
+{
+  return *(uint64_t *) ticks;
+}
+
+/**
+ * This function checks the ttl_hashmap functions of the hashmap library.
+ * If one of them fails at some points, the functions exits with exit code 1.
+ */
+void test_ttl_hash_map(void)
+{
+  uint64_t ticks = 0;
+  assert(ttl_hashmap_alloc (hash_char, NULL, NULL) == NULL);
+  ttl_hashmap *map = ttl_hashmap_alloc (hash_char, fake_clock, &ticks);
+  assert(map);
+  pair *pairs_array[MID_SIZE];
+  int i = 0;
+  for (i = 0; i < MID_SIZE; i++)
+    {
+      char char_key = (char) (i + ASCII_A);
+      int int_value = i;
+      pairs_array[i] = pair_alloc (&char_key, &int_value, char_key_cpy,
+                                   int_value_cpy,
+                                   char_key_cmp, int_value_cmp, char_key_free,
+                                   int_value_free);
+      assert(pairs_array[i]);
+    }
+  // key i lives TTL_SHORT * i ticks (key 0 forever), the last one far longer
+  for (i = 0; i < MID_SIZE - 1; i++)
+    {
+      assert(ttl_hashmap_insert (map, pairs_array[i], TTL_SHORT * i) == 1);
+    }
+  assert(ttl_hashmap_insert (map, pairs_array[MID_SIZE - 1], TTL_LONG) == 1);
+  assert(ttl_hashmap_insert (map, pairs_array[1], TTL_SHORT) == 0);
+  ticks = TTL_SHORT;
+  assert(ttl_hashmap_at (map, pairs_array[1]->key) == NULL);
+  assert(map->map->size == (size_t) MID_SIZE - 1);
+  assert(ttl_hashmap_expire (map) == 0);
+  ticks = TTL_SHORT * SIZE_10;
+  assert(ttl_hashmap_set_ttl (map, pairs_array[SIZE_9]->key, TTL_SHORT) == 0);
+  assert(ttl_hashmap_set_ttl (map, pairs_array[SIZE_10 + 1]->key, TTL_LONG)
+         == 1);
+  assert(ttl_hashmap_expire (map) == (size_t) SIZE_8);
+  assert(*(int *) ttl_hashmap_at (map, pairs_array[0]->key) == 0);
+  ticks = TTL_SHORT * MID_SIZE;
+  assert(ttl_hashmap_expire (map) == (size_t) TTL_LATE_EXPIRED);
+  assert(*(int *) ttl_hashmap_at (map, pairs_array[SIZE_10 + 1]->key)
+         == SIZE_10 + 1);
+  ticks = TTL_LONG + TTL_SHORT * SIZE_10;
+  assert(ttl_hashmap_at (map, pairs_array[SIZE_10 + 1]->key) == NULL);
+  assert(ttl_hashmap_expire (map) == 1);
+  assert(map->map->size == 1);
+  // far beyond the wheel, expiring must jump over the empty ticks
+  assert(ttl_hashmap_insert (map, pairs_array[1], TTL_HUGE) == 1);
+  ticks += TTL_HUGE - 1;
+  assert(ttl_hashmap_expire (map) == 0);
+  ticks++;
+  assert(ttl_hashmap_expire (map) == 1);
+  assert(map->map->size == 1);
+  assert(ttl_hashmap_erase (map, pairs_array[0]->key) == 1);
+  assert(ttl_hashmap_erase (map, pairs_array[0]->key) == 0);
+  assert(map->timed == 0);
+  for (i = 0; i < MID_SIZE; i++)
+    {
+      pair_free ((void **) &pairs_array[i]);
+    }
+  ttl_hashmap_free (&map);
+  assert(map == NULL);
+}
+
+/**
+ * This function checks the hashset functions of the hashmap library.
+ * If one of them fails at some points, the functions exits with exit code 1.
+ */
+void test_hash_set(void)
+{
+  assert(hashset_alloc (hash_char, NULL, char_key_cmp, char_key_free) == NULL);
+  hashset *evens = hashset_alloc (hash_char, char_key_cpy, char_key_cmp,
+                                  char_key_free);
+  hashset *thirds = hashset_alloc (hash_char, char_key_cpy, char_key_cmp,
+                                   char_key_free);
+  assert(evens && thirds);
+  int i = 0;
+  for (i = 0; i < MID_SIZE; i++)
+    {
+      char char_key = (char) (i + ASCII_A);
+      if (i % 2 == 0)
+        {
+          assert(hashset_insert (evens, &char_key) == 1);
+          assert(hashset_insert (evens, &char_key) == 0);
+        }
+      if (i % SIZE_3 == 0)
+        {
+          assert(hashset_insert (thirds, &char_key) == 1);
+        }
+    }
+  char char_key = (char) (SIZE_4 + ASCII_A);
+  assert(hashset_contains (evens, &char_key) == 1);
+  assert(hashset_contains (thirds, &char_key) == 0);
+  assert(hashset_erase (evens, &char_key) == 1);
+  assert(hashset_erase (evens, &char_key) == 0);
+  assert(hashset_insert (evens, &char_key) == 1);
+  assert(hashset_union (evens, thirds) == 1);
+  assert(hashset_size (evens) == (size_t) 24);
+  assert(hashset_union (evens, evens) == 1);
+  assert(hashset_size (evens) == (size_t) 24);
+  assert(hashset_difference (evens, thirds) == 1);
+  assert(hashset_size (evens) == (size_t) 12);
+  assert(hashset_intersect (thirds, evens) == 1);
+  assert(hashset_size (thirds) == 0);
+  assert(hashset_union (thirds, evens) == 1);
+  assert(hashset_intersect (thirds, evens) == 1);
+  assert(hashset_size (thirds) == (size_t) 12);
+  for (i = 0; i < MID_SIZE; i++)
+    {
+      char_key = (char) (i + ASCII_A);
+      assert(hashset_contains (thirds, &char_key)
+             == (i % 2 == 0 && i % SIZE_3 != 0));
+    }
+  assert(hashset_difference (thirds, thirds) == 1);
+  assert(hashset_size (thirds) == 0);
+  hashset_free (&evens);
+  hashset_free (&thirds);
+  assert(evens == NULL);
+}
+
+/**
+ * A hash giving every two neighbouring chars the same full hash.
+ */
+size_t hash_char_halved (const void *elem)
+{
+  return hash_char (elem) / 2;
+}
+
+/**
+ * This function checks the frozen_hashmap functions of the hashmap library.
+ * If one of them fails at some points, the functions exits with exit code 1.
+ */
+void test_frozen_hash_map(void)
+{
+  hashmap *hash_map = hashmap_alloc (hash_char);
+  assert(hash_map);
+  assert(hashmap_freeze (NULL, sizeof(char), sizeof(int)) == NULL);
+  frozen_hashmap *frozen = hashmap_freeze (hash_map, sizeof(char),
+                                           sizeof(int));
+  assert(frozen);
+  char char_key = (char) ASCII_A;
+  assert(frozen_hashmap_at (frozen, &char_key) == NULL);
+  frozen_hashmap_free (&frozen);
+  int i = 0;
+  for (i = 0; i < MID_SIZE; i++)
+    {
+      char_key = (char) (i + ASCII_A);
+      int int_value = i;
+      pair *new_pair = pair_alloc (&char_key, &int_value, char_key_cpy,
+                                   int_value_cpy,
+                                   char_key_cmp, int_value_cmp, char_key_free,
+                                   int_value_free);
+      assert(new_pair);
+      assert(hashmap_insert (hash_map, new_pair) == 1);
+      pair_free ((void **) &new_pair);
+    }
+  frozen = hashmap_freeze (hash_map, sizeof(char), sizeof(int));
+  assert(frozen);
+  assert(frozen->size == (size_t) MID_SIZE);
+  FILE *file = tmpfile ();
+  assert(file);
+  assert(frozen_hashmap_save (frozen, file) == 1);
+  rewind (file);
+  frozen_hashmap *loaded = frozen_hashmap_load (file, hash_char);
+  assert(loaded);
+  // another hash func fails the fingerprint
+  rewind (file);
+  assert(frozen_hashmap_load (file, hash_char_flood) == NULL);
+  // a size the single key groups could not address is refused up front
+  uint64_t header[] = {FROZEN_HASHMAP_MAGIC, FROZEN_HASHMAP_VERSION,
+                       FROZEN_HASHMAP_DIRECT, sizeof(char), sizeof(int), 0};
+  rewind (file);
+  assert(fwrite (header, sizeof(header), 1, file) == 1);
+  rewind (file);
+  assert(frozen_hashmap_load (file, hash_char) == NULL);
+  fclose (file);
+  for (i = 0; i < MID_SIZE; i++)
+    {
+      char_key = (char) (i + ASCII_A);
+      assert(*(const int *) frozen_hashmap_at (frozen, &char_key) == i);
+      assert(*(const int *) frozen_hashmap_at (loaded, &char_key) == i);
+    }
+  char_key = (char) (MID_SIZE + ASCII_A);
+  assert(frozen_hashmap_at (frozen, &char_key) == NULL);
+  assert(frozen_hashmap_at (loaded, &char_key) == NULL);
+  frozen_hashmap_free (&frozen);
+  frozen_hashmap_free (&loaded);
+  assert(frozen == NULL);
+  hashmap_free (&hash_map);
+  // keys sharing a full hash are refused at once
+  hash_map = hashmap_alloc (hash_char_halved);
+  assert(hash_map);
+  for (i = 0; i < MID_SIZE; i++)
+    {
+      char_key = (char) (i + ASCII_A);
+      pair *new_pair = pair_alloc (&char_key, &i, char_key_cpy,
+                                   int_value_cpy,
+                                   char_key_cmp, int_value_cmp, char_key_free,
+                                   int_value_free);
+      assert(new_pair);
+      assert(hashmap_insert (hash_map, new_pair) == 1);
+      pair_free ((void **) &new_pair);
+    }
+  assert(hashmap_freeze (hash_map, sizeof(char), sizeof(int)) == NULL);
+  hashmap_free (&hash_map);
+}
+
+/**
+ * This function checks the filtered_hashmap functions of the hashmap
+ * library, and that a lookup hashes its key only once.
+ * If one of them fails at some points, the functions exits with exit code 1.
+ */
+void test_filtered_hash_map(void)
+{
+  filtered_hashmap *map = filtered_hashmap_alloc (hash_char);
+  assert(map);
+  assert((uintptr_t) map->blocks % FILTER_BLOCK_BYTES == 0);
+  assert(filtered_hashmap_false_positive_rate (map) == 0);
+  int i = 0;
+  for (i = 0; i < MID_SIZE; i++)
+    {
+      char char_key = (char) (i + ASCII_A);
+      int int_value = i;
+      pair *new_pair = pair_alloc (&char_key, &int_value, char_key_cpy,
+                                   int_value_cpy,
+                                   char_key_cmp, int_value_cmp, char_key_free,
+                                   int_value_free);
+      assert(new_pair);
+      assert(filtered_hashmap_insert (map, new_pair) == 1);
+      assert(filtered_hashmap_insert (map, new_pair) == 0);
+      pair_free ((void **) &new_pair);
+    }
+  assert(map->stats.rebuilds > 0);
+  assert(map->sized_for == map->map->capacity);
+  size_t misses = 0;
+  for (i = 0; i < CHAR_COUNT; i++)
+    {
+      char char_key = (char) i;
+      int *value = filtered_hashmap_at (map, &char_key);
+      if (i >= ASCII_A && i < ASCII_A + MID_SIZE)
+        {
+          assert(value && *value == i - ASCII_A);
+        }
+      else
+        {
+          assert(value == NULL);
+          misses++;
+        }
+    }
+  assert(map->stats.lookups == (size_t) CHAR_COUNT);
+  assert(map->stats.filtered + map->stats.false_positives == misses);
+  assert(filtered_hashmap_false_positive_rate (map) < MAX_FP_RATE);
+  for (i = 0; i < MID_SIZE; i++)
+    {
+      char char_key = (char) (i + ASCII_A);
+      assert(filtered_hashmap_erase (map, &char_key) == 1);
+      assert(filtered_hashmap_erase (map, &char_key) == 0);
+      assert(filtered_hashmap_at (map, &char_key) == NULL);
+    }
+  assert(map->sized_for == map->map->capacity);
+  size_t filtered = map->stats.filtered;
+  char char_key = (char) ASCII_A;
+  assert(filtered_hashmap_at (map, &char_key) == NULL);
+  assert(map->stats.filtered == filtered + 1);
+  assert(filtered_hashmap_false_positive_rate (NULL) == -1);
+  filtered_hashmap_free (&map);
+  assert(map == NULL);
+  // a lookup hashes its key once, for the filter and the map
+  map = filtered_hashmap_alloc (hash_char_counted);
+  assert(map);
+  int int_value = 0;
+  pair *new_pair = pair_alloc (&char_key, &int_value, char_key_cpy,
+                               int_value_cpy, char_key_cmp, int_value_cmp,
+                               char_key_free, int_value_free);
+  assert(new_pair);
+  assert(filtered_hashmap_insert (map, new_pair) == 1);
+  flood_hash_calls = 0;
+  assert(*(int *) filtered_hashmap_at (map, &char_key) == 0);
+  assert(flood_hash_calls == 1);
+  pair_free ((void **) &new_pair);
+  filtered_hashmap_free (&map);
+}
+
+/**
+ * This function checks the cow_hashmap functions of the hashmap library,
+ * and that a write after a snapshot copies only the segment it touches.
+ * If one of them fails at some points, the functions exits with exit code 1.
+ */
+void test_cow_hash_map(void)
+{
+  cow_hashmap *live = cow_hashmap_alloc (hash_char);
+  assert(live);
+  int i = 0;
+  for (i = 0; i < MID_SIZE; i++)
+    {
+      char char_key = (char) (i + ASCII_A);
+      int int_value = i;
+      pair *new_pair = pair_alloc (&char_key, &int_value, char_key_cpy,
+                                   int_value_cpy,
+                                   char_key_cmp, int_value_cmp, char_key_free,
+                                   int_value_free);
+      assert(new_pair);
+      assert(cow_hashmap_insert (live, new_pair) == 1);
+      assert(cow_hashmap_insert (live, new_pair) == 0);
+      pair_free ((void **) &new_pair);
+    }
+  cow_snapshot *before = hashmap_snapshot (live);
+  assert(before && cow_snapshot_size (before) == (size_t) MID_SIZE);
+  cow_snapshot *reader = hashmap_snapshot (live);
+  assert(reader == before);
+  cow_snapshot_release (&reader);
+  assert(reader == NULL);
+  char char_key = (char) ASCII_A;
+  assert(cow_hashmap_erase (live, &char_key) == 1);
+  assert(cow_hashmap_at (live, &char_key) == NULL);
+  assert(*(const int *) cow_snapshot_at (before, &char_key) == 0);
+  cow_snapshot *middle = cow_snapshot_retain (hashmap_snapshot (live));
+  assert(middle && middle != before);
+  // growing the live map copies the pairs the snapshots still share
+  for (i = 0; i < ASCII_A; i++)
+    {
+      char_key = (char) i;
+      int int_value = i;
+      pair *new_pair = pair_alloc (&char_key, &int_value, char_key_cpy,
+                                   int_value_cpy,
+                                   char_key_cmp, int_value_cmp, char_key_free,
+                                   int_value_free);
+      assert(new_pair);
+      assert(cow_hashmap_insert (live, new_pair) == 1);
+      pair_free ((void **) &new_pair);
+    }
+  assert(live->table->capacity > before->table->capacity);
+  reader = middle;
+  cow_snapshot_release (&reader);
+  cow_snapshot *after = hashmap_snapshot (live);
+  for (i = 0; i < ASCII_A + MID_SIZE; i++)
+    {
+      char_key = (char) i;
+      assert(cow_hashmap_erase (live, &char_key) == (i != ASCII_A));
+    }
+  assert(live->table->size == 0);
+  assert(cow_snapshot_size (middle) == (size_t) MID_SIZE - 1);
+  cow_snapshot_release (&middle);
+  cow_hashmap_free (&live);
+  assert(live == NULL);
+  for (i = 0; i < ASCII_A + MID_SIZE; i++)
+    {
+      char_key = (char) i;
+      const int *value = cow_snapshot_at (after, &char_key);
+      assert(i == ASCII_A ? value == NULL : *value == i % ASCII_A);
+      value = cow_snapshot_at (before, &char_key);
+      assert(i < ASCII_A ? value == NULL : *value == i - ASCII_A);
+    }
+  cow_snapshot_release (&after);
+  cow_snapshot_release (&before);
+
+  // a write after a snapshot copies one segment of a many segment table
+  live = cow_hashmap_alloc (hash_int);
+  assert(live);
+  for (i = 0; i < COW_SIZE; i++)
+    {
+      pair *new_pair = pair_alloc (&i, &i, int_value_cpy, int_value_cpy,
+                                   int_value_cmp, int_value_cmp,
+                                   int_value_free, int_value_free);
+      assert(new_pair);
+      assert(cow_hashmap_insert (live, new_pair) == 1);
+      pair_free ((void **) &new_pair);
+    }
+  before = hashmap_snapshot (live);
+  assert(before && before->table->segment_count > 1);
+  i = 0;
+  assert(cow_hashmap_erase (live, &i) == 1);
+  size_t copied = 0;
+  size_t s = 0;
+  for (s = 0; s < live->table->segment_count; s++)
+    {
+      copied += live->table->segments[s] != before->table->segments[s];
+    }
+  assert(copied == 1);
+  assert(*(const int *) cow_snapshot_at (before, &i) == 0);
+  cow_hashmap_free (&live);
+  cow_snapshot_release (&before);
+
+  // a flooded bucket is a sorted chain, as in hashmap, also once copied
+  live = cow_hashmap_alloc (hash_char_counted);
+  assert(live);
+  for (i = 0; i < MID_SIZE; i++)
+    {
+      char_key = (char) (MID_SIZE - i + ASCII_A);
+      pair *new_pair = pair_alloc (&char_key, &i, char_key_cpy,
+                                   int_value_cpy, char_key_cmp,
+                                   int_value_cmp, char_key_free,
+                                   int_value_free);
+      assert(new_pair);
+      assert(cow_hashmap_insert (live, new_pair) == 1);
+      pair_free ((void **) &new_pair);
+    }
+  before = hashmap_snapshot (live);
+  assert(before);
+  for (i = 0; i < MID_SIZE; i += 2)
+    {
+      char_key = (char) (MID_SIZE - i + ASCII_A);
+      assert(cow_hashmap_erase (live, &char_key) == 1);
+    }
+  for (i = 0; i < MID_SIZE; i++)
+    {
+      char_key = (char) (MID_SIZE - i + ASCII_A);
+      flood_hash_calls = 0;
+      const int *value = cow_hashmap_at (live, &char_key);
+      assert(flood_hash_calls == 1);
+      assert(i % 2 == 0 ? value == NULL : *value == i);
+      assert(*(const int *) cow_snapshot_at (before, &char_key) == i);
+    }
+  cow_hashmap_free (&live);
+  cow_snapshot_release (&before);
+}
+
+/**
+ * This function checks that tables rehashed by several threads keep every
+ * pair, growing and shrinking.
+ * If one of them fails at some points, the functions exits with exit code 1.
+ */
+void test_hash_map_parallel_rehash(void)
+{
+  hashmap *hash_map = hashmap_alloc (hash_int);
+  pair **pairs = calloc (sizeof(pair *), PARALLEL_SIZE);
+  assert(hash_map && pairs);
+  assert(hashmap_set_rehash_threads (NULL, REHASH_THREADS) == 0);
+  assert(hashmap_set_rehash_threads (hash_map, REHASH_THREADS) == 1);
+  int i = 0;
+  for (i = 0; i < PARALLEL_SIZE; i++)
+    {
+      int value = -i;
+      pairs[i] = pair_alloc (&i, &value, int_value_cpy, int_value_cpy,
+                             int_value_cmp, int_value_cmp, int_value_free,
+                             int_value_free);
+      assert(pairs[i]);
+    }
+  assert(hashmap_insert_all (hash_map, pairs, PARALLEL_SIZE)
+         == (size_t) PARALLEL_SIZE);
+  assert(hashmap_insert_all (hash_map, pairs, PARALLEL_SIZE) == 0);
+  assert(hashmap_get_load_factor (hash_map) <= LARGE_LOAD);
+  // large enough to be split across the rehash threads
+  assert(hashmap_reserve (hash_map, SIZE_4 * PARALLEL_SIZE) == 1);
+  assert(hash_map->capacity >= HASH_MAP_PARALLEL_MIN_CAP * SIZE_4);
+  assert(hash_map->size == (size_t) PARALLEL_SIZE);
+  for (i = 0; i < PARALLEL_SIZE; i++)
+    {
+      assert(*(int *) hashmap_at (hash_map, &i) == -i);
+    }
+  for (i = 0; i < PARALLEL_SIZE; i += 2)
+    {
+      assert(hashmap_erase (hash_map, &i) == 1);
+    }
+  assert(hashmap_compact (hash_map) == 1);
+  assert(hashmap_get_load_factor (hash_map) >= SMALL_LOAD);
+  for (i = 0; i < PARALLEL_SIZE; i++)
+    {
+      int *value = hashmap_at (hash_map, &i);
+      assert(i % 2 == 0 ? value == NULL : *value == -i);
+      pair_free ((void **) &pairs[i]);
+    }
+  free (pairs);
+  hashmap_free (&hash_map);
+}
+
+/**
+ * Checks if a char key is not a digit, the opposite of is_digit.
+ */
+int is_not_digit (const_keyT elem)
+{
+  return !is_digit (elem);
+}
+
+/**
+ * Keeps the larger value of a key both maps hold.
+ */
+int keep_larger (pair *dst_pair, const pair *src_pair)
+{
+  return *(int *) src_pair->value > *(int *) dst_pair->value;
+}
+
+/**
+ * This function checks hashmap_merge, on maps and multimaps, and
+ * hashmap_erase_if.
+ * If one of them fails at some points, the functions exits with exit code 1.
+ */
+void test_hash_map_merge(void)
+{
+  hashmap *dst = hashmap_alloc (hash_char);
+  hashmap *src = hashmap_alloc (hash_char);
+  assert(dst && src);
+  int i = 0;
+  for (i = 0; i < MID_SIZE; i++)
+    {
+      char char_key = (char) (i + ASCII_A);
+      int int_value = i;
+      pair *new_pair = pair_alloc (&char_key, &int_value, char_key_cpy,
+                                   int_value_cpy,
+                                   char_key_cmp, int_value_cmp, char_key_free,
+                                   int_value_free);
+      assert(new_pair);
+      if (i % 2 == 0)
+        {
+          assert(hashmap_insert (dst, new_pair) == 1);
+        }
+      if (i % SIZE_3 == 0)
+        {
+          // conflicting keys: src's value wins only for i % 4 == 0
+          *(int *) new_pair->value = i % SIZE_4 == 0 ? i + 1 : i - 1;
+        }
+      if (i % 2 != 0 || i % SIZE_3 == 0)
+        {
+          assert(hashmap_insert (src, new_pair) == 1);
+        }
+      pair_free ((void **) &new_pair);
+    }
+  assert(hashmap_merge (dst, dst, keep_larger) == 0);
+  assert(hashmap_merge (dst, src, keep_larger) == 1);
+  assert(src->size == 0);
+  assert(src->capacity == HASH_MAP_INITIAL_CAP);
+  assert(dst->size == (size_t) MID_SIZE);
+  assert(hashmap_get_load_factor (dst) <= LARGE_LOAD);
+  for (i = 0; i < MID_SIZE; i++)
+    {
+      char char_key = (char) (i + ASCII_A);
+      int expected = i;
+      if (i % 2 == 0 && i % SIZE_3 == 0 && i % SIZE_4 == 0)
+        {
+          expected = i + 1;
+        }
+      else if (i % 2 != 0 && i % SIZE_3 == 0)
+        {
+          expected = i % SIZE_4 == 0 ? i + 1 : i - 1;
+        }
+      assert(*(int *) hashmap_at (dst, &char_key) == expected);
+      assert(hashmap_at (src, &char_key) == NULL);
+    }
+  assert(hashmap_merge (src, dst, NULL) == 1);
+  assert(src->size == (size_t) MID_SIZE && dst->size == 0);
+  assert(hashmap_erase_if (NULL, is_digit) == -1);
+  assert(hashmap_erase_if (src, is_digit) == 0);
+  char digit = '7';
+  int int_value = SIZE_7;
+  pair *digit_pair = pair_alloc (&digit, &int_value, char_key_cpy,
+                                 int_value_cpy, char_key_cmp, int_value_cmp,
+                                 char_key_free, int_value_free);
+  assert(digit_pair && hashmap_insert (src, digit_pair) == 1);
+  assert(hashmap_erase_if (src, is_digit) == 1);
+  assert(hashmap_at (src, &digit) == NULL);
+  assert(hashmap_erase_if (src, is_not_digit) == MID_SIZE);
+  assert(src->size == 0);
+  assert(hashmap_insert (src, digit_pair) == 1);
+  assert(*(int *) hashmap_at (src, &digit) == SIZE_7);
+  pair_free ((void **) &digit_pair);
+  // multimaps move a key's group whole, a conflict keeps one whole group:
+  // src holds a -> 1, 2, 3 and b -> 4, 5, dst holds a -> 0
+  hashmap *multi = hashmap_alloc (hash_char);
+  assert(multi);
+  for (i = 0; i < SIZE_5; i++)
+    {
+      char char_key = (char) (ASCII_A + (i < SIZE_3 ? 0 : 1));
+      int value = i + 1;
+      pair *new_pair = pair_alloc (&char_key, &value, char_key_cpy,
+                                   int_value_cpy,
+                                   char_key_cmp, int_value_cmp, char_key_free,
+                                   int_value_free);
+      assert(new_pair);
+      assert(hashmap_multi_insert (multi, new_pair) == 1);
+      if (i == 0)
+        {
+          *(int *) new_pair->value = 0;
+          assert(hashmap_insert (dst, new_pair) == 1);
+        }
+      pair_free ((void **) &new_pair);
+    }
+  assert(hashmap_merge (dst, multi, keep_larger) == 1);
+  assert(multi->size == 0 && dst->size == (size_t) SIZE_5);
+  for (i = 0; i < 2; i++)
+    {
+      char char_key = (char) (ASCII_A + i);
+      size_t count = 0;
+      pair *const *group = hashmap_multi_range (dst, &char_key, &count);
+      assert(count == (size_t) (i == 0 ? SIZE_3 : 2));
+      size_t k = 0;
+      for (k = 0; k < count; k++)
+        {
+          assert(*(int *) group[k]->value == (int) k + 1 + i * SIZE_3);
+        }
+    }
+  // replacing a group is charged only what it adds, so an exactly full
+  // account still takes a smaller group replacing a larger one
+  hashmap_account full;
+  assert(hashmap_account_init (&full, 0, NULL, NULL) == 1);
+  assert(hashmap_set_account (dst, &full) == 1);
+  full.budget = hashmap_account_bytes (&full);
+  char char_key = (char) ASCII_A;
+  int_value = SIZE_9;
+  pair *new_pair = pair_alloc (&char_key, &int_value, char_key_cpy,
+                               int_value_cpy, char_key_cmp, int_value_cmp,
+                               char_key_free, int_value_free);
+  assert(new_pair && hashmap_insert (multi, new_pair) == 1);
+  pair_free ((void **) &new_pair);
+  assert(hashmap_merge (dst, multi, keep_larger) == 1);
+  assert(hashmap_account_bytes (&full) < full.budget);
+  assert(hashmap_account_bytes (&full) == hashmap_memory (dst));
+  assert(dst->size == (size_t) SIZE_3);
+  assert(*(int *) hashmap_at (dst, &char_key) == SIZE_9);
+  hashmap_free (&multi);
+  hashmap_free (&dst);
+  assert(hashmap_account_bytes (&full) == 0);
+  hashmap_account_destroy (&full);
+  hashmap_free (&src);
+}
+
+/**
+ * This function reports the bytes of a char key to an account.
+ */
+size_t char_size (const void *elem)
+{
+  (void) elem;
+  return sizeof(char);
+}
+
+/**
+ * This function reports the bytes of an int value to an account.
+ */
+size_t int_size (const void *elem)
+{
+  (void) elem;
+  return sizeof(int);
+}
+
+/**
+ * This function reports the bytes of an int value to an account as the
+ * value itself, so that values changed in place change their size.
+ */
+size_t int_weight (const void *elem)
+{
+  return (size_t) *(const int *) elem;
+}
+
+/**
+ * This function evicts for an account by erasing the smallest key left,
+ * one pair per call.
+ */
+int evict_smallest (void *ctx, size_t needed)
+{
+  (void) needed;
+  hashmap *hash_map = ctx;
+  int i = 0;
+  for (i = 0; i < CHAR_COUNT; i++)
+    {
+      char char_key = (char) i;
+      if (hashmap_erase (hash_map, &char_key) == 1)
+        {
+          return 1;
+        }
+    }
+  return 0;
+}
+
+/**
+ * This function checks that a map is charged to its own account: every
+ * pair, vector and bucket array it holds, moved whole between accounts,
+ * released when freed, and that a budget fails inserts cleanly or evicts.
+ */
+void test_hash_map_account(void)
+{
+  hashmap_account account;
+  assert(hashmap_account_init (&account, 0, char_size, int_size) == 1);
+  hashmap *hash_map = hashmap_alloc (hash_char);
+  assert(hash_map);
+  assert(hashmap_account_bytes (&account) == 0);
+  assert(hashmap_set_account (hash_map, &account) == 1);
+  size_t empty = hashmap_account_bytes (&account);
+  assert(empty == hashmap_memory (hash_map));
+  assert(empty >= sizeof(hashmap) + HASH_MAP_INITIAL_CAP * sizeof(void *));
+  int i = 0;
+  for (i = 0; i < MID_SIZE; i++)
+    {
+      char char_key = (char) (i + ASCII_A);
+      int int_value = i;
+      pair *new_pair = pair_alloc (&char_key, &int_value, char_key_cpy,
+                                   int_value_cpy,
+                                   char_key_cmp, int_value_cmp, char_key_free,
+                                   int_value_free);
+      assert(new_pair);
+      assert(hashmap_insert (hash_map, new_pair) == 1);
+      pair_free ((void **) &new_pair);
+    }
+  assert(hashmap_erase_if (hash_map, is_digit) == 0);
+  size_t full = hashmap_account_bytes (&account);
+  assert(full == hashmap_memory (hash_map));
+  assert(full >= empty + MID_SIZE * (sizeof(pair) + sizeof(char)
+                                     + sizeof(int)));
+  assert(account.peak >= full);
+  // a second map on the same account, unaccounted maps never touch it
+  hashmap *other = hashmap_alloc (hash_char);
+  assert(other);
+  assert(hashmap_set_account (other, &account) == 1);
+  assert(hashmap_account_bytes (&account) == full + empty);
+  assert(hashmap_set_account (other, NULL) == 1);
+  assert(hashmap_account_bytes (&account) == full);
+  hashmap_free (&other);
+  assert(hashmap_account_bytes (&account) == full);
+  // a full budget fails inserts cleanly, or evicts to make room
+  hashmap_account bounded;
+  assert(hashmap_account_init (&bounded, full, char_size, int_size) == 1);
+  assert(hashmap_set_account (hash_map, &bounded) == 1);
+  assert(hashmap_account_bytes (&account) == 0);
+  assert(hashmap_account_bytes (&bounded) == full);
+  char char_key = (char) (MID_SIZE + ASCII_A);
+  int int_value = MID_SIZE;
+  pair *new_pair = pair_alloc (&char_key, &int_value, char_key_cpy,
+                               int_value_cpy, char_key_cmp, int_value_cmp,
+                               char_key_free, int_value_free);
+  assert(new_pair);
+  assert(hashmap_insert (hash_map, new_pair) == 0);
+  assert(hashmap_account_bytes (&bounded) == full);
+  assert(hash_map->size == (size_t) MID_SIZE);
+  hashmap_account_set_evict (&bounded, evict_smallest, hash_map);
+  assert(hashmap_insert (hash_map, new_pair) == 1);
+  assert(hashmap_account_bytes (&bounded) <= full);
+  assert(hashmap_account_bytes (&bounded) == hashmap_memory (hash_map));
+  assert(*(int *) hashmap_at (hash_map, &char_key) == MID_SIZE);
+  char_key = (char) ASCII_A;
+  assert(hashmap_at (hash_map, &char_key) == NULL);
+  pair_free ((void **) &new_pair);
+  hashmap_free (&hash_map);
+  assert(hashmap_account_bytes (&bounded) == 0);
+  // pooled buckets, adopted midway and rehashed, are accounted the same
+  hash_map = hashmap_alloc (hash_char);
+  assert(hash_map);
+  assert(hashmap_set_account (hash_map, &account) == 1);
+  bucket_policy policy = {BUCKET_ALLOC_HUGE_PAGES, 0};
+  for (i = 0; i < MID_SIZE; i++)
+    {
+      if (i == LOW_SIZE)
+        {
+          assert(hashmap_set_bucket_policy (hash_map, &policy) == 1);
+          assert(hashmap_account_bytes (&account)
+                 == hashmap_memory (hash_map));
+        }
+      char_key = (char) (i + ASCII_A);
+      int_value = i;
+      new_pair = pair_alloc (&char_key, &int_value, char_key_cpy,
+                             int_value_cpy, char_key_cmp, int_value_cmp,
+                             char_key_free, int_value_free);
+      assert(new_pair);
+      assert(hashmap_insert (hash_map, new_pair) == 1);
+      pair_free ((void **) &new_pair);
+    }
+  assert(hashmap_account_bytes (&account) == hashmap_memory (hash_map));
+  for (i = 0; i < MID_SIZE; i += 2)
+    {
+      char_key = (char) (i + ASCII_A);
+      assert(hashmap_erase (hash_map, &char_key) == 1);
+    }
+  assert(hashmap_compact (hash_map) == 1);
+  assert(hashmap_account_bytes (&account) == hashmap_memory (hash_map));
+  for (i = 1; i < MID_SIZE; i += 2)
+    {
+      char_key = (char) (i + ASCII_A);
+      assert(*(int *) hashmap_at (hash_map, &char_key) == i);
+    }
+  hashmap_free (&hash_map);
+  assert(hashmap_account_bytes (&account) == 0);
+  // values grown in place are charged what they grew, and each pair
+  // releases exactly its charge
+  hashmap_account weighted;
+  assert(hashmap_account_init (&weighted, 0, char_size, int_weight) == 1);
+  hash_map = hashmap_alloc (hash_char);
+  assert(hash_map);
+  assert(hashmap_set_account (hash_map, &weighted) == 1);
+  for (i = 0; i < MID_SIZE; i++)
+    {
+      char_key = (char) (i + ASCII_A);
+      int_value = i;
+      new_pair = pair_alloc (&char_key, &int_value, char_key_cpy,
+                             int_value_cpy, char_key_cmp, int_value_cmp,
+                             char_key_free, int_value_free);
+      assert(new_pair);
+      assert(hashmap_insert (hash_map, new_pair) == 1);
+      pair_free ((void **) &new_pair);
+    }
+  size_t before = hashmap_account_bytes (&weighted);
+  assert(hashmap_apply_if (hash_map, is_not_digit, double_value) == MID_SIZE);
+  assert(hashmap_account_bytes (&weighted)
+         == before + (size_t) MID_SIZE * (MID_SIZE - 1) / 2);
+  assert(hashmap_account_bytes (&weighted) == hashmap_memory (hash_map));
+  // moved to an account too small for the growth, values keep their charge
+  hashmap_account tight;
+  assert(hashmap_account_init (&tight, hashmap_memory (hash_map) + 1,
+                               char_size, int_weight) == 1);
+  assert(hashmap_set_account (hash_map, &tight) == 1);
+  assert(hashmap_account_bytes (&weighted) == 0);
+  assert(hashmap_apply_if (hash_map, is_not_digit, double_value) == MID_SIZE);
+  assert(hashmap_account_bytes (&tight) <= tight.budget);
+  assert(hashmap_account_bytes (&tight) == hashmap_memory (hash_map));
+  assert(hashmap_erase_if (hash_map, is_not_digit) == MID_SIZE);
+  hashmap_free (&hash_map);
+  assert(hashmap_account_bytes (&tight) == 0);
+  hashmap_account_destroy (&tight);
+  hashmap_account_destroy (&weighted);
+  hashmap_account_destroy (&bounded);
+  hashmap_account_destroy (&account);
+}
+
+/**
+ * This function checks the multimap mode: the pairs of a key stay one
+ * group in insertion order, even with every key in a single bucket, and
+ * erasing one pair or a whole group keeps the other groups intact.
+ */
+void test_hash_map_multi(void)
+{
+  // every key in one sorted chain, inserted interleaved
+  hashmap *hash_map = hashmap_alloc (hash_char_flood);
+  assert(hash_map);
+  int r = 0;
+  int k = 0;
+  for (r = 0; r < SIZE_10; r++)
+    {
+      for (k = 0; k < SIZE_4; k++)
+        {
+          char char_key = (char) (k + ASCII_A);
+          pair *new_pair = pair_alloc (&char_key, &r, char_key_cpy,
+                                       int_value_cpy,
+                                       char_key_cmp, int_value_cmp,
+                                       char_key_free, int_value_free);
+          assert(new_pair);
+          assert(hashmap_insert (hash_map, new_pair) == (r == 0));
+          assert(r == 0 || hashmap_multi_insert (hash_map, new_pair) == 1);
+          pair_free ((void **) &new_pair);
+        }
+    }
+  assert(hash_map->size == (size_t) SIZE_10 * SIZE_4);
+  size_t count = 0;
+  for (k = 0; k < SIZE_4; k++)
+    {
+      char char_key = (char) (k + ASCII_A);
+      assert(hashmap_multi_count (hash_map, &char_key) == SIZE_10);
+      pair *const *group = hashmap_multi_range (hash_map, &char_key, &count);
+      assert(group && count == SIZE_10);
+      for (r = 0; r < SIZE_10; r++)
+        {
+          assert(*(char *) group[r]->key == char_key);
+          assert(*(int *) group[r]->value == r);
+        }
+      assert(*(int *) hashmap_at (hash_map, &char_key) == 0);
+    }
+  char char_key = (char) ASCII_A;
+  int int_value = SIZE_5;
+  assert(hashmap_multi_erase (hash_map, &char_key, &int_value) == 1);
+  assert(hashmap_multi_erase (hash_map, &char_key, &int_value) == 0);
+  pair *const *group = hashmap_multi_range (hash_map, &char_key, &count);
+  assert(count == SIZE_9);
+  for (r = 0; r < SIZE_9; r++)
+    {
+      assert(*(int *) group[r]->value == (r < SIZE_5 ? r : r + 1));
+    }
+  char_key = (char) (ASCII_A + 1);
+  assert(hashmap_multi_erase_all (hash_map, &char_key) == SIZE_10);
+  assert(hashmap_multi_erase_all (hash_map, &char_key) == 0);
+  assert(hashmap_multi_range (hash_map, &char_key, &count) == NULL);
+  assert(count == 0);
+  char_key = (char) (ASCII_A + 2);
+  assert(hashmap_multi_count (hash_map, &char_key) == SIZE_10);
+  assert(hash_map->size == (size_t) SIZE_10 * SIZE_4 - SIZE_10 - 1);
+  hashmap_free (&hash_map);
+}
+
+/**
+ * This function checks that a logged map is rebuilt from its log, that
+ * replicas catch up from it, that a record cut short is dropped, and that
+ * a checkpoint restarts the log after a snapshot that reopening loads.
+ */
+void test_logged_hash_map(void)
+{
+  // a fresh name per run, so concurrent runs never share a log
+  char log_path[] = LOG_TEMPLATE;
+  int fd = mkstemp (log_path);
+  assert(fd != -1);
+  close (fd);
+  remove (log_path);
+  char snapshot_path[sizeof(LOG_TEMPLATE) + sizeof(SNAPSHOT_SUFFIX)];
+  snprintf (snapshot_path, sizeof(snapshot_path), "%s" SNAPSHOT_SUFFIX,
+            log_path);
+  char char_key = (char) ASCII_A;
+  int int_value = 0;
+  pair *functions = pair_alloc (&char_key, &int_value, char_key_cpy,
+                                int_value_cpy,
+                                char_key_cmp, int_value_cmp, char_key_free,
+                                int_value_free);
+  assert(functions);
+  assert(logged_hashmap_open (log_path, hash_char, functions, sizeof(char),
+                              sizeof(int), 0, 1) == NULL);
+  logged_hashmap *logged = logged_hashmap_open (log_path, hash_char,
+                                                functions, sizeof(char),
+                                                sizeof(int), SIZE_4, 1);
+  assert(logged && logged->map->size == 0 && logged->sequence == 0);
+  int i = 0;
+  for (i = 0; i < MID_SIZE; i++)
+    {
+      char_key = (char) (i + ASCII_A);
+      int_value = i;
+      pair *new_pair = pair_alloc (&char_key, &int_value, char_key_cpy,
+                                   int_value_cpy,
+                                   char_key_cmp, int_value_cmp, char_key_free,
+                                   int_value_free);
+      assert(new_pair);
+      assert(logged_hashmap_insert (logged, new_pair) == 1);
+      // a failed change is not logged
+      assert(logged_hashmap_insert (logged, new_pair) == 0);
+      pair_free ((void **) &new_pair);
+    }
+  char_key = (char) ASCII_A;
+  int_value = -1;
+  assert(logged_hashmap_update (logged, &char_key, &int_value) == 1);
+  char_key = (char) (ASCII_A + 1);
+  assert(logged_hashmap_erase (logged, &char_key) == 1);
+  assert(logged_hashmap_erase (logged, &char_key) == 0);
+  assert(logged_hashmap_update (logged, &char_key, &int_value) == 0);
+  assert(logged->sequence == (uint64_t) MID_SIZE + 2);
+  assert(logged_hashmap_close (&logged) == 1 && logged == NULL);
+
+  // the log rebuilds the map, but only with the sizes it was written with
+  assert(logged_hashmap_open (log_path, hash_char, functions, sizeof(char),
+                              sizeof(double), SIZE_4, 1) == NULL);
+  logged = logged_hashmap_open (log_path, hash_char, functions,
+                                sizeof(char), sizeof(int), SIZE_4, 1);
+  assert(logged && logged->sequence == (uint64_t) MID_SIZE + 2);
+  assert(logged->map->size == (size_t) MID_SIZE - 1);
+  char_key = (char) ASCII_A;
+  assert(*(int *) hashmap_at (logged->map, &char_key) == -1);
+  char_key = (char) (ASCII_A + 1);
+  assert(hashmap_at (logged->map, &char_key) == NULL);
+  for (i = 2; i < MID_SIZE; i++)
+    {
+      char_key = (char) (i + ASCII_A);
+      assert(*(int *) hashmap_at (logged->map, &char_key) == i);
+    }
+
+  // a replica replays the log and later catches up from where it stopped
+  hashmap *replica = hashmap_alloc (hash_char);
+  assert(replica);
+  uint64_t sequence = 0;
+  assert(hashmap_log_replay (replica, log_path, functions, &sequence) == 1);
+  assert(sequence == (uint64_t) MID_SIZE + 2);
+  assert(replica->size == (size_t) MID_SIZE - 1);
+  char_key = (char) (ASCII_A + 1);
+  int_value = 1;
+  pair *new_pair = pair_alloc (&char_key, &int_value, char_key_cpy,
+                               int_value_cpy,
+                               char_key_cmp, int_value_cmp, char_key_free,
+                               int_value_free);
+  assert(new_pair);
+  assert(logged_hashmap_insert (logged, new_pair) == 1);
+  pair_free ((void **) &new_pair);
+  assert(logged_hashmap_commit (logged) == 1);
+  assert(hashmap_log_replay (replica, log_path, functions, &sequence) == 1);
+  assert(sequence == (uint64_t) MID_SIZE + 3);
+  assert(replica->size == (size_t) MID_SIZE);
+  assert(*(int *) hashmap_at (replica, &char_key) == 1);
+  hashmap_free (&replica);
+  assert(logged_hashmap_close (&logged) == 1);
+
+  // a record cut short by a crash is dropped on reopening
+  FILE *file = fopen (log_path, "ab");
+  assert(file);
+  assert(fwrite ("torn", 4, 1, file) == 1);
+  fclose (file);
+  logged = logged_hashmap_open (log_path, hash_char, functions,
+                                sizeof(char), sizeof(int), SIZE_4, 0);
+  assert(logged && logged->sequence == (uint64_t) MID_SIZE + 3);
+  assert(logged->map->size == (size_t) MID_SIZE);
+  char_key = (char) (MID_SIZE + ASCII_A);
+  assert(logged_hashmap_erase (logged, &char_key) == 0);
+  char_key = (char) ASCII_A;
+  assert(logged_hashmap_erase (logged, &char_key) == 1);
+  assert(logged_hashmap_close (&logged) == 1);
+  logged = logged_hashmap_open (log_path, hash_char, functions,
+                                sizeof(char), sizeof(int), SIZE_4, 0);
+  assert(logged && logged->sequence == (uint64_t) MID_SIZE + 4);
+  assert(logged->map->size == (size_t) MID_SIZE - 1);
+  assert(hashmap_at (logged->map, &char_key) == NULL);
+
+  // a checkpoint snapshots the map, the log keeps only what follows
+  assert(logged_hashmap_checkpoint (logged) == 1);
+  char_key = (char) (ASCII_A + 2);
+  int_value = -2;
+  assert(logged_hashmap_update (logged, &char_key, &int_value) == 1);
+  assert(logged_hashmap_close (&logged) == 1);
+  replica = hashmap_alloc (hash_char);
+  assert(replica);
+  sequence = 0;
+  assert(hashmap_log_replay (replica, log_path, functions, &sequence) == 0);
+  assert(replica->size == 0);
+  assert(hashmap_snapshot_load (replica, log_path, functions, &sequence)
+         == 1);
+  assert(sequence == (uint64_t) MID_SIZE + 4);
+  assert(replica->size == (size_t) MID_SIZE - 1);
+  assert(hashmap_log_replay (replica, log_path, functions, &sequence) == 1);
+  assert(sequence == (uint64_t) MID_SIZE + 5);
+  assert(*(int *) hashmap_at (replica, &char_key) == -2);
+  hashmap_free (&replica);
+  logged = logged_hashmap_open (log_path, hash_char, functions,
+                                sizeof(char), sizeof(int), SIZE_4, 0);
+  assert(logged && logged->sequence == (uint64_t) MID_SIZE + 5);
+  assert(logged->map->size == (size_t) MID_SIZE - 1);
+  assert(*(int *) hashmap_at (logged->map, &char_key) == -2);
+  char_key = (char) ASCII_A;
+  assert(hashmap_at (logged->map, &char_key) == NULL);
+  assert(logged_hashmap_close (&logged) == 1);
+  pair_free ((void **) &functions);
+  remove (log_path);
+  remove (snapshot_path);
+}
+
 //int main ()
 //{
 //  test_hash_map_insert();
@@ -290,4 +1765,20 @@ void test_hash_map_apply_if()
 //  test_hash_map_erase();
 //  test_hash_map_get_load_factor();
 //  test_hash_map_apply_if();
+//  test_sharded_hash_map();
+//  test_bucket_alloc();
+//  test_compact_hash_map();
+//  test_hash_map_flooding();
+//  test_hash_map_compact();
+//  test_cache_hash_map();
+//  test_ttl_hash_map();
+//  test_hash_set();
+//  test_frozen_hash_map();
+//  test_filtered_hash_map();
+//  test_cow_hash_map();
+//  test_hash_map_parallel_rehash();
+//  test_hash_map_merge();
+//  test_hash_map_account();
+//  test_hash_map_multi();
+//  test_logged_hash_map();
 //}
\ No newline at end of file
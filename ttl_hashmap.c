@@ -0,0 +1,368 @@
+#include "ttl_hashmap.h"
+#include "hashmap_ext.h"
+
+#define TTL_WHEEL_MASK (TTL_WHEEL_SLOTS - 1)
+#define TTL_WHEEL_SPAN(level) (((uint64_t) 1) << (TTL_WHEEL_BITS * (level)))
+#define TTL_DE_BRUIJN 0x03f79d71b4cb0a89ULL
+#define TTL_NO_TICK UINT64_MAX
+
+// Index of the lowest set bit of x (not 0), by a de Bruijn multiplication.
+int ttl_lowest_bit (uint64_t x)
+{
+  static const int index[64] = {
+      0, 1, 48, 2, 57, 49, 28, 3, 61, 58, 50, 42, 38, 29, 17, 4,
+      62, 55, 59, 36, 53, 51, 43, 22, 45, 39, 33, 30, 24, 18, 12, 5,
+      63, 47, 56, 27, 60, 41, 37, 16, 54, 35, 52, 21, 44, 32, 23, 11,
+      46, 26, 40, 15, 34, 20, 31, 10, 25, 14, 19, 9, 13, 8, 7, 6};
+  return index[((x & (~x + 1)) * TTL_DE_BRUIJN) >> 58];
+}
+
+// The number of positions (1 to TTL_WHEEL_SLOTS) from position to the next
+// occupied slot after it, going round the level, 0 if the level is empty.
+uint64_t ttl_slot_distance (uint64_t occupied, size_t position)
+{
+  if (occupied == 0)
+    {
+      return 0;
+    }
+  size_t shift = (position + 1) & TTL_WHEEL_MASK;
+  uint64_t rotated = occupied >> shift;
+  if (shift != 0)
+    {
+      rotated |= occupied << (TTL_WHEEL_SLOTS - shift);
+    }
+  return (uint64_t) ttl_lowest_bit(rotated) + 1;
+}
+
+// The first tick after the wheel's current time at which a non-empty level 0
+// slot is reached or a non-empty slot of a coarser level cascades.
+uint64_t ttl_next_tick (const ttl_hashmap *map)
+{
+  uint64_t next = TTL_NO_TICK;
+  int level = 0;
+  for (level = 0; level < TTL_WHEEL_LEVELS; level++)
+    {
+      uint64_t turns = map->now >> (TTL_WHEEL_BITS * level);
+      uint64_t distance = ttl_slot_distance(map->occupied[level],
+                                            turns & TTL_WHEEL_MASK);
+      uint64_t tick = (turns + distance) << (TTL_WHEEL_BITS * level);
+      if (distance != 0 && tick < next)
+        {
+          next = tick;
+        }
+    }
+  return next;
+}
+
+// Value callbacks of the pairs stored in the underlying hashmap. The entry is
+// copied shallowly, the copy owns the user's value from then on.
+void *ttl_entry_copy (const_valueT value)
+{
+  ttl_entry *entry = malloc(sizeof(ttl_entry));
+  if (entry == NULL)
+    {
+      return NULL;
+    }
+  *entry = *((const ttl_entry *) value);
+  return entry;
+}
+
+int ttl_entry_cmp (const_valueT value_1, const_valueT value_2)
+{
+  const ttl_entry *a = value_1;
+  const ttl_entry *b = value_2;
+  return a->value_cmp(a->value, b->value);
+}
+
+void ttl_entry_free (valueT *value)
+{
+  if (value == NULL || *value == NULL)
+    {
+      return;
+    }
+  ttl_entry *entry = *value;
+  entry->value_free(&entry->value);
+  free(entry);
+  *value = NULL;
+}
+
+// Links an entry into the wheel slot matching how far its expiry is from the
+// wheel's current time. Expiries beyond the last level wait in its farthest
+// slot and are placed again when that slot cascades.
+void ttl_wheel_add (ttl_hashmap *map, ttl_entry *entry)
+{
+  uint64_t expires = entry->expires;
+  uint64_t delta = expires > map->now ? expires - map->now : 0;
+  int level = 0;
+  while (level < TTL_WHEEL_LEVELS - 1 && delta >= TTL_WHEEL_SPAN(level + 1))
+    {
+      level++;
+    }
+  if (delta >= TTL_WHEEL_SPAN(TTL_WHEEL_LEVELS))
+    {
+      expires = map->now + TTL_WHEEL_SPAN(TTL_WHEEL_LEVELS) - 1;
+    }
+  size_t slot = (expires >> (TTL_WHEEL_BITS * level)) & TTL_WHEEL_MASK;
+  entry->level = (unsigned char) level;
+  entry->slot = (unsigned char) slot;
+  entry->prev = NULL;
+  entry->next = map->wheel[level][slot];
+  if (entry->next != NULL)
+    {
+      entry->next->prev = entry;
+    }
+  map->wheel[level][slot] = entry;
+  map->occupied[level] |= ((uint64_t) 1) << slot;
+}
+
+void ttl_wheel_remove (ttl_hashmap *map, ttl_entry *entry)
+{
+  if (entry->prev != NULL)
+    {
+      entry->prev->next = entry->next;
+    }
+  else
+    {
+      map->wheel[entry->level][entry->slot] = entry->next;
+      if (entry->next == NULL)
+        {
+          map->occupied[entry->level] &= ~(((uint64_t) 1) << entry->slot);
+        }
+    }
+  if (entry->next != NULL)
+    {
+      entry->next->prev = entry->prev;
+    }
+  entry->prev = NULL;
+  entry->next = NULL;
+}
+
+// Sets the expiry of an entry and (re)links it into the wheel.
+void ttl_set_expiry (ttl_hashmap *map, ttl_entry *entry, uint64_t ttl)
+{
+  if (entry->expires != TTL_NO_EXPIRY)
+    {
+      ttl_wheel_remove(map, entry);
+      map->timed--;
+    }
+  entry->expires = TTL_NO_EXPIRY;
+  if (ttl != TTL_NO_EXPIRY)
+    {
+      entry->expires = map->clock(map->clock_ctx) + ttl;
+      ttl_wheel_add(map, entry);
+      map->timed++;
+    }
+}
+
+// Erases the pair of an entry from the map, unlinking it from the wheel.
+int ttl_drop (ttl_hashmap *map, ttl_entry *entry)
+{
+  ttl_set_expiry(map, entry, TTL_NO_EXPIRY);
+  return hashmap_erase(map->map, entry->key);
+}
+
+/**
+ * Allocates dynamically new ttl hash map.
+ * @param func a function which "hashes" keys.
+ * @param clock the clock expiry times are measured with.
+ * @param clock_ctx passed to clock as is.
+ * @return pointer to dynamically allocated ttl hashmap.
+ * @if_fail return NULL.
+ */
+ttl_hashmap *ttl_hashmap_alloc (hash_func func, ttl_clock_func clock,
+                                void *clock_ctx)
+{
+  if (func == NULL || clock == NULL)
+    {
+      return NULL;
+    }
+  ttl_hashmap *map = calloc(sizeof(*map), 1);
+  if (map == NULL)
+    {
+      return NULL;
+    }
+  map->map = hashmap_alloc(func);
+  if (map->map == NULL)
+    {
+      free(map);
+      return NULL;
+    }
+  map->clock = clock;
+  map->clock_ctx = clock_ctx;
+  map->now = clock(clock_ctx);
+  return map;
+}
+
+/**
+ * Frees a ttl hash map and all the pairs it holds.
+ * @param p_map pointer to dynamically allocated pointer to ttl_hashmap.
+ */
+void ttl_hashmap_free (ttl_hashmap **p_map)
+{
+  if (p_map == NULL || *p_map == NULL)
+    {
+      return;
+    }
+  hashmap_free(&(*p_map)->map);
+  free(*p_map);
+  *p_map = NULL;
+}
+
+/**
+ * Inserts a copy of in_pair, expiring ttl ticks from now.
+ * @param map the ttl hash map.
+ * @param in_pair a pair the map would contain.
+ * @param ttl ticks to live, TTL_NO_EXPIRY for a pair that never expires.
+ * @return returns 1 for successful insertion, 0 otherwise.
+ */
+int ttl_hashmap_insert (ttl_hashmap *map, const pair *in_pair, uint64_t ttl)
+{
+  if (map == NULL || in_pair == NULL || in_pair->key == NULL ||
+      in_pair->value == NULL || ttl_hashmap_at(map, in_pair->key) != NULL)
+    {
+      return 0;
+    }
+  ttl_entry proto = {NULL, NULL, TTL_NO_EXPIRY, NULL, NULL, in_pair->value_cpy,
+                     in_pair->value_cmp, in_pair->value_free, 0, 0};
+  proto.value = in_pair->value_cpy(in_pair->value);
+  if (proto.value == NULL)
+    {
+      return 0;
+    }
+  pair wrapped = *in_pair;
+  wrapped.value = &proto;
+  wrapped.value_cpy = ttl_entry_copy;
+  wrapped.value_cmp = ttl_entry_cmp;
+  wrapped.value_free = ttl_entry_free;
+  if (hashmap_insert(map->map, &wrapped) == 0)
+    {
+      proto.value_free(&proto.value);
+      return 0;
+    }
+  pair *stored = hashmap_find(map->map, in_pair->key);
+  ttl_entry *entry = stored->value;
+  entry->key = stored->key;
+  ttl_set_expiry(map, entry, ttl);
+  return 1;
+}
+
+/**
+ * Returns the value associated with the given key, erasing the pair instead
+ * if it has expired.
+ * @param map the ttl hash map.
+ * @param key the key to be checked.
+ * @return the value associated with key if exists and alive, NULL otherwise.
+ */
+valueT ttl_hashmap_at (ttl_hashmap *map, const_keyT key)
+{
+  if (map == NULL)
+    {
+      return NULL;
+    }
+  ttl_entry *entry = hashmap_at(map->map, key);
+  if (entry == NULL)
+    {
+      return NULL;
+    }
+  if (entry->expires != TTL_NO_EXPIRY
+      && entry->expires <= map->clock(map->clock_ctx))
+    {
+      ttl_drop(map, entry);
+      return NULL;
+    }
+  return entry->value;
+}
+
+/**
+ * Sets the time to live of an existing pair, counted from now.
+ * @param map the ttl hash map.
+ * @param key the key of the pair.
+ * @param ttl ticks to live, TTL_NO_EXPIRY for a pair that never expires.
+ * @return 1 if succeeded, 0 if the key is not in the map (or expired).
+ */
+int ttl_hashmap_set_ttl (ttl_hashmap *map, const_keyT key, uint64_t ttl)
+{
+  if (ttl_hashmap_at(map, key) == NULL)
+    {
+      return 0;
+    }
+  ttl_set_expiry(map, hashmap_at(map->map, key), ttl);
+  return 1;
+}
+
+/**
+ * The function erases the pair associated with key.
+ * @param map the ttl hash map.
+ * @param key a key of the pair to be erased.
+ * @return 1 if the erasing was done successfully, 0 otherwise.
+ */
+int ttl_hashmap_erase (ttl_hashmap *map, const_keyT key)
+{
+  if (map == NULL)
+    {
+      return 0;
+    }
+  ttl_entry *entry = hashmap_at(map->map, key);
+  if (entry == NULL)
+    {
+      return 0;
+    }
+  return ttl_drop(map, entry);
+}
+
+/**
+ * Turns the timing wheel up to the current time and erases every pair that
+ * expired meanwhile. Only the ticks that reach a non-empty slot are visited.
+ * @param map the ttl hash map.
+ * @return the number of erased pairs.
+ */
+size_t ttl_hashmap_expire (ttl_hashmap *map)
+{
+  if (map == NULL)
+    {
+      return 0;
+    }
+  uint64_t now = map->clock(map->clock_ctx);
+  size_t counter = 0;
+  while (map->now < now && map->timed > 0)
+    {
+      // the ticks skipped would only have turned empty slots
+      uint64_t next = ttl_next_tick(map);
+      if (next > now)
+        {
+          break;
+        }
+      map->now = next;
+      // Coarser levels first, so their pairs can fall further down the
+      // levels within the same tick.
+      int level = 0;
+      for (level = TTL_WHEEL_LEVELS - 1; level > 0; level--)
+        {
+          if ((map->now & (TTL_WHEEL_SPAN(level) - 1)) != 0)
+            {
+              continue;
+            }
+          size_t slot = (map->now >> (TTL_WHEEL_BITS * level))
+                        & TTL_WHEEL_MASK;
+          ttl_entry *entry = map->wheel[level][slot];
+          map->wheel[level][slot] = NULL;
+          map->occupied[level] &= ~(((uint64_t) 1) << slot);
+          while (entry != NULL)
+            {
+              ttl_entry *next = entry->next;
+              ttl_wheel_add(map, entry);
+              entry = next;
+            }
+        }
+      ttl_entry *entry = map->wheel[0][map->now & TTL_WHEEL_MASK];
+      while (entry != NULL)
+        {
+          ttl_entry *next = entry->next;
+          ttl_drop(map, entry);
+          counter++;
+          entry = next;
+        }
+    }
+  map->now = now;
+  return counter;
+}
@@ -0,0 +1,121 @@
+#ifndef TTL_HASHMAP_H_
+#define TTL_HASHMAP_H_
+
+#include <stdint.h>
+#include "hashmap.h"
+
+// At most 6, a level's occupied slots are the bits of one uint64_t.
+#define TTL_WHEEL_BITS 6
+#define TTL_WHEEL_SLOTS (1UL << TTL_WHEEL_BITS)
+#define TTL_WHEEL_LEVELS 4
+#define TTL_NO_EXPIRY 0
+
+/**
+ * Returns the current time in ticks of the caller's choice (ms, s, ...).
+ * Must never go backwards.
+ */
+typedef uint64_t (*ttl_clock_func) (void *);
+
+typedef void *(*ttl_value_cpy) (const_valueT);
+typedef int (*ttl_value_cmp) (const_valueT, const_valueT);
+typedef void (*ttl_value_free) (valueT *);
+
+/**
+ * The value the underlying hashmap holds for every pair: the user's value,
+ * its expiry time and its links in a timing wheel slot.
+ */
+typedef struct ttl_entry {
+    valueT value;
+    keyT key;
+    uint64_t expires;
+    struct ttl_entry *prev;
+    struct ttl_entry *next;
+    ttl_value_cpy value_cpy;
+    ttl_value_cmp value_cmp;
+    ttl_value_free value_free;
+    unsigned char level;
+    unsigned char slot;
+} ttl_entry;
+
+/**
+ * A hashmap whose pairs may expire.
+ * Expired pairs are dropped lazily by ttl_hashmap_at, and reclaimed in bulk
+ * by ttl_hashmap_expire using a hierarchical timing wheel of
+ * TTL_WHEEL_LEVELS levels of TTL_WHEEL_SLOTS slots: a pair sits in the level
+ * matching how far its expiry is and is cascaded to finer levels as the
+ * wheel turns, so each tick only touches the pairs that expire in it.
+ * Every level keeps a bitmap of its non-empty slots, so ttl_hashmap_expire
+ * jumps straight to the next tick with work to do, whatever the time
+ * elapsed.
+ */
+typedef struct ttl_hashmap {
+    hashmap *map;
+    ttl_entry *wheel[TTL_WHEEL_LEVELS][TTL_WHEEL_SLOTS];
+    uint64_t occupied[TTL_WHEEL_LEVELS];
+    uint64_t now;
+    size_t timed;
+    ttl_clock_func clock;
+    void *clock_ctx;
+} ttl_hashmap;
+
+/**
+ * Allocates dynamically new ttl hash map.
+ * @param func a function which "hashes" keys.
+ * @param clock the clock expiry times are measured with.
+ * @param clock_ctx passed to clock as is.
+ * @return pointer to dynamically allocated ttl hashmap.
+ * @if_fail return NULL.
+ */
+ttl_hashmap *ttl_hashmap_alloc (hash_func func, ttl_clock_func clock,
+                                void *clock_ctx);
+
+/**
+ * Frees a ttl hash map and all the pairs it holds.
+ * @param p_map pointer to dynamically allocated pointer to ttl_hashmap.
+ */
+void ttl_hashmap_free (ttl_hashmap **p_map);
+
+/**
+ * Inserts a copy of in_pair, expiring ttl ticks from now.
+ * @param map the ttl hash map.
+ * @param in_pair a pair the map would contain.
+ * @param ttl ticks to live, TTL_NO_EXPIRY for a pair that never expires.
+ * @return returns 1 for successful insertion, 0 otherwise.
+ */
+int ttl_hashmap_insert (ttl_hashmap *map, const pair *in_pair, uint64_t ttl);
+
+/**
+ * Returns the value associated with the given key, erasing the pair instead
+ * if it has expired.
+ * @param map the ttl hash map.
+ * @param key the key to be checked.
+ * @return the value associated with key if exists and alive, NULL otherwise.
+ */
+valueT ttl_hashmap_at (ttl_hashmap *map, const_keyT key);
+
+/**
+ * Sets the time to live of an existing pair, counted from now.
+ * @param map the ttl hash map.
+ * @param key the key of the pair.
+ * @param ttl ticks to live, TTL_NO_EXPIRY for a pair that never expires.
+ * @return 1 if succeeded, 0 if the key is not in the map (or expired).
+ */
+int ttl_hashmap_set_ttl (ttl_hashmap *map, const_keyT key, uint64_t ttl);
+
+/**
+ * The function erases the pair associated with key.
+ * @param map the ttl hash map.
+ * @param key a key of the pair to be erased.
+ * @return 1 if the erasing was done successfully, 0 otherwise.
+ */
+int ttl_hashmap_erase (ttl_hashmap *map, const_keyT key);
+
+/**
+ * Turns the timing wheel up to the current time and erases every pair that
+ * expired meanwhile.
+ * @param map the ttl hash map.
+ * @return the number of erased pairs.
+ */
+size_t ttl_hashmap_expire (ttl_hashmap *map);
+
+#endif // TTL_HASHMAP_H_
@@ -129,24 +129,21 @@ int vector_push_back(vector *vector, const void *value)
     {
       return 0;
     }
-  size_t cap = vector->capacity;
   if (pre_vector_get_load_factor(vector, 1) > VECTOR_MAX_LOAD_FACTOR)
     {
-      vector->data = realloc(vector->data, sizeof(void*) *
+      void **data = realloc(vector->data, sizeof(void*) *
       (vector->capacity * VECTOR_GROWTH_FACTOR));
-      if (vector->data == NULL)
+      if (data == NULL)
         {
           return 0;
         }
+      vector->data = data;
       vector->capacity = vector->capacity * VECTOR_GROWTH_FACTOR;
     }
+  // a failed copy keeps the grown slots, capacity still tells their number
   vector->data[vector->size] = vector->elem_copy_func(value);
   if (vector->data[vector->size] == NULL)
     {
-      if (cap != vector->capacity)
-        {
-          vector->capacity = vector->capacity / VECTOR_GROWTH_FACTOR;
-        }
       return 0;
     }
   vector->size++;
@@ -187,12 +184,13 @@ int vector_erase(vector *vector, size_t ind)
     }
   if (pre_vector_get_load_factor(vector, -1) < VECTOR_MIN_LOAD_FACTOR)
     {
-      vector->data = realloc(vector->data, sizeof(void*) *
+      void **data = realloc(vector->data, sizeof(void*) *
       (vector->capacity / VECTOR_GROWTH_FACTOR));
-      if (vector->data == NULL)
+      if (data == NULL)
         {
           return 0;
         }
+      vector->data = data;
       vector->capacity = vector->capacity / VECTOR_GROWTH_FACTOR;
     }
   vector->elem_free_func(&vector->data[ind]);